@@ -0,0 +1,611 @@
+#include "../lisp/lisp.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BENCH_HAS_FORK 1
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// benchmarks of generated workloads, each run through tokenize, Parser, Environment and
+// Evaluator separately and through run_file end to end. the results are written as JSON,
+// and compared with the JSON of an earlier run given by --baseline.
+//
+// with --source=MB it instead runs a generated script of MB megabytes through the stream
+// reader and through --mmap, each in a process of its own, and prints the time to the
+// first result, the total time and the peak RSS of both (the fastest of 2 rounds each).
+//
+// usage: bench [--json=FILE] [--baseline=FILE] [--tolerance=PCT] [--min-time=MS]
+//              [--filter=TEXT] [--write=DIR]
+//        bench --source=MB [--write=DIR]
+
+namespace {
+
+    struct Options {
+        std::string json;
+        std::string baseline;
+        double tolerance = 10;      // percent of ns/op over the baseline which is a regression
+        double min_time_ms = 500;   // of each measurement, after one op to warm up
+        std::string filter;         // runs only "workload/stage" names containing it
+        std::string dir;            // where the workloads are written for run_file
+        size_t source_mb = 0;       // size of the script of the source benchmark; 0 skips it
+    };
+
+    struct Workload {
+        std::string name;
+        std::string source;
+    };
+
+    struct Result {
+        std::string workload;
+        std::string stage;
+        size_t ops = 0;
+        double ns_per_op = 0;
+        double ops_per_sec = 0;
+        size_t items_per_op = 0;    // tokens, forms or bindings handled by one op
+        double objects_per_op = 0;  // allocated on the heap
+        double bytes_per_op = 0;
+        size_t collections = 0;
+    };
+
+    // xorshift64*, so that every platform and standard library generates the same workloads
+    class Random {
+    private:
+        std::uint64_t state;
+    public:
+        Random(std::uint64_t seed) : state(seed) {}
+        std::uint32_t next(std::uint32_t bound) {
+            this->state ^= this->state >> 12;
+            this->state ^= this->state << 25;
+            this->state ^= this->state >> 27;
+            return (std::uint32_t)((this->state * 0x2545F4914F6CDD1Dull) >> 32) % bound;
+        }
+    };
+
+    /* workloads */
+    // long lines of many small tokens: numbers, strings, chars, booleans and short lists
+    std::string long_lines() {
+        Random random(1);
+        std::string source;
+        for (int form = 0; form < 20; form++) {
+            source += "(count (list";
+            for (int i = 0; i < 2000; i++) {
+                switch (random.next(6)) {
+                case 0: source += " " + std::to_string(random.next(100000)); break;
+                case 1: source += " -" + std::to_string(random.next(1000)); break;
+                case 2: source += " \"s" + std::to_string(random.next(1000)) + " t\""; break;
+                case 3: source += std::string(" '") + (char)('a' + random.next(26)) + "'"; break;
+                case 4: source += random.next(2) ? " true" : " null"; break;
+                default: source += " (list " + std::to_string(random.next(10)) + " false)"; break;
+                }
+            }
+            source += "))\n";
+        }
+        return source;
+    }
+
+    // let* nested 200 deep, every binding using the one before it; the first one comes from
+    // a native, so that constant folding leaves the chain for the Evaluator
+    std::string deep_let() {
+        Random random(2);
+        std::string source;
+        const int depth = 200;
+        for (int form = 0; form < 20; form++) {
+            source += "(let* (v0 (count (list " + std::to_string(random.next(100)) + " 2 3)))";
+            for (int i = 1; i < depth; i++) {
+                std::string previous = "v" + std::to_string(i - 1);
+                std::string oper = random.next(2) ? "+" : "-";
+                source += "\n  (let* (v" + std::to_string(i) + " (" + oper + " " + previous + " "
+                          + std::to_string(random.next(10)) + "))";
+            }
+            source += " v" + std::to_string(depth - 1) + std::string(depth, ')') + "\n";
+        }
+        return source;
+    }
+
+    // balanced trees of + and - over let* variables bound to natives, which constant
+    // folding cannot remove
+    void arithmetic_tree(Random& random, int depth, std::string& out) {
+        if (depth == 0) {
+            const char* leaves[] = {"a", "b", "c", "d"};
+            out += random.next(8) == 0 ? std::to_string(random.next(10)) : leaves[random.next(4)];
+            return;
+        }
+        out += random.next(2) ? "(+ " : "(- ";
+        arithmetic_tree(random, depth - 1, out);
+        out += " ";
+        arithmetic_tree(random, depth - 1, out);
+        out += ")";
+    }
+
+    std::string wide_arithmetic() {
+        Random random(3);
+        std::string source;
+        for (int form = 0; form < 8; form++) {
+            source += "(let* (a (count (list 1 2 3)) b (count (list 1)) c (count (list)) d (count (list 1 2))) ";
+            arithmetic_tree(random, 11, source);
+            source += ")\n";
+        }
+        return source;
+    }
+
+    // balanced trees of (+ a b) over two globals, which keep them from folding: the nested
+    // arithmetic whose dispatch on node kinds was the hottest path of the tree walker
+    void add_tree(int depth, std::string& out) {
+        if (depth == 0) {
+            out += "(+ a b)";
+            return;
+        }
+        out += "(+ ";
+        add_tree(depth - 1, out);
+        out += " ";
+        add_tree(depth - 1, out);
+        out += ")";
+    }
+
+    std::string nested_add() {
+        std::string source = "(def! a 3)\n(def! b 4)\n";
+        for (int form = 0; form < 50; form++) {
+            add_tree(6, source);
+            source += "\n";
+        }
+        return source;
+    }
+
+    // thousands of def! forms, then forms reading them
+    std::string many_globals() {
+        Random random(4);
+        const int count = 3000;
+        std::string source;
+        for (int i = 0; i < count; i++)
+            source += "(def! g" + std::to_string(i) + " " + std::to_string(random.next(1000)) + ")\n";
+        for (int i = 0; i < 1000; i++)
+            source += "(+ g" + std::to_string(random.next(count)) + " g" + std::to_string(random.next(count)) + ")\n";
+        return source;
+    }
+
+    // a long script mixing function definitions, calls, lists and let* forms
+    std::string large_file() {
+        Random random(5);
+        std::string source;
+        int functions = 0;
+        for (int form = 0; form < 4000; form++) {
+            std::string a = std::to_string(random.next(100)), b = std::to_string(random.next(100));
+            switch (functions == 0 ? 0 : random.next(5)) {
+            case 0:
+                source += "(def! f" + std::to_string(functions++) + " (fn* (x y) (if (< x y) (+ x (* y 2)) (- x y))))\n";
+                break;
+            case 1:
+            case 2:
+                source += "(f" + std::to_string(random.next(functions)) + " " + a + " " + b + ")\n";
+                break;
+            case 3:
+                source += "(count (list " + a + " \"" + b + "\" (list " + a + " " + b + ")))\n";
+                break;
+            default:
+                source += "(let* (x " + a + " y " + b + ") (if (= x y) 0 (f"
+                          + std::to_string(random.next(functions)) + " x y)))\n";
+                break;
+            }
+        }
+        return source;
+    }
+
+    // a recursive function of comparisons and arithmetic, which is mostly calls and operators
+    std::string recursive_calls() {
+        return "(def! fib (fn* (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))\n(fib 20)\n";
+    }
+
+    std::vector<Workload> workloads() {
+        return {
+            {"long_lines", long_lines()},
+            {"deep_let", deep_let()},
+            {"wide_arithmetic", wide_arithmetic()},
+            {"nested_add", nested_add()},
+            {"many_globals", many_globals()},
+            {"large_file", large_file()},
+            {"recursive_calls", recursive_calls()},
+        };
+    }
+
+    /* measurement */
+    // a heap of its own for each measurement, so that its counts are not mixed with others
+    struct LocalHeap {
+        lisp::Heap heap;
+        LocalHeap() { lisp::use_heap(&this->heap); }
+        ~LocalHeap() { lisp::use_heap(nullptr); }
+    };
+
+    bool selected(const Options& options, const std::string& workload, const std::string& stage) {
+        return options.filter.empty() || (workload + "/" + stage).find(options.filter) != std::string::npos;
+    }
+
+    // the ops are timed in ROUNDS rounds of min_time / ROUNDS each, and the fastest round
+    // gives ns/op: other load on the machine only makes a round slower
+    const int ROUNDS = 5;
+
+    template <typename Op>
+    Result measure(const Options& options, const std::string& workload, const std::string& stage, Op op) {
+        Result result;
+        result.workload = workload;
+        result.stage = stage;
+        result.items_per_op = op();
+
+        lisp::GcStats before = lisp::heap().stats();
+        double total_ms = 0;
+        result.ns_per_op = 0;
+        for (int round = 0; round < ROUNDS; round++) {
+            auto start = std::chrono::steady_clock::now();
+            size_t ops = 0;
+            double elapsed_ms = 0;
+            do {
+                op();
+                ops++;
+                elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            } while (elapsed_ms < options.min_time_ms / ROUNDS);
+            double ns_per_op = elapsed_ms * 1e6 / ops;
+            if (round == 0 || ns_per_op < result.ns_per_op) result.ns_per_op = ns_per_op;
+            result.ops += ops;
+            total_ms += elapsed_ms;
+        }
+        lisp::GcStats after = lisp::heap().stats();
+
+        result.ops_per_sec = 1e9 / result.ns_per_op;
+        result.objects_per_op = (double)(after.allocated_objects - before.allocated_objects) / result.ops;
+        result.bytes_per_op = (double)(after.allocated_bytes - before.allocated_bytes) / result.ops;
+        result.collections = after.collections - before.collections;
+        std::cerr << "{Bench} " << workload << "/" << stage << ": " << result.ops << " ops in " << total_ms << " ms, "
+                  << result.ns_per_op / 1000 << " us/op, " << result.objects_per_op << " objects/op\n";
+        return result;
+    }
+
+    std::vector<std::string_view> split_forms(const std::string& source) {
+        std::vector<std::string_view> forms;
+        lisp::Reader reader{std::string_view(source)};
+        std::string_view form;
+        while (reader.next(form)) forms.push_back(form);
+        return forms;
+    }
+
+    void run_workload(const Options& options, const Workload& workload, std::vector<Result>& results) {
+        const std::string& name = workload.name;
+        std::vector<std::string_view> forms = split_forms(workload.source);
+
+        if (selected(options, name, "tokenize")) {
+            LocalHeap local;
+            results.push_back(measure(options, name, "tokenize", [&] {
+                size_t tokens = 0;
+                for (std::string_view form : forms) tokens += lisp::tokenize(form).size();
+                return tokens;
+            }));
+        }
+
+        if (selected(options, name, "parse")) {
+            LocalHeap local;
+            results.push_back(measure(options, name, "parse", [&] {
+                for (std::string_view form : forms) lisp::read_str(form);
+                return forms.size();
+            }));
+        }
+
+        // the symbols of the workload, bound in a new table and then looked up
+        if (selected(options, name, "environment")) {
+            std::vector<lisp::SymbolId> symbols;
+            std::unordered_set<lisp::SymbolId> seen;
+            for (const std::string& token : lisp::tokenize(workload.source)) {
+                char c = token[0];
+                if (c == '(' || c == ')' || c == '"' || c == '\'' || c == '-' || (c >= '0' && c <= '9')) continue;
+                if (token == "true" || token == "false" || token == "null") continue;
+                lisp::SymbolId symbol = lisp::intern(token);
+                if (symbol >= lisp::SYM_BUILTIN_COUNT && seen.insert(symbol).second) symbols.push_back(symbol);
+            }
+            LocalHeap local;
+            results.push_back(measure(options, name, "environment", [&] {
+                lisp::Environment environment;
+                for (size_t i = 0; i < symbols.size(); i++) environment.add(symbols[i], lisp::Value::integer((int)i));
+                for (int round = 0; round < 4; round++)
+                    for (lisp::SymbolId symbol : symbols) environment.get(symbol);
+                return symbols.size();
+            }));
+        }
+
+        // forms parsed and folded once, as run_file does, then run again and again
+        if (selected(options, name, "eval")) {
+            LocalHeap local;
+            std::vector<lisp::Parser> parsers;
+            for (std::string_view form : forms) {
+                parsers.push_back(lisp::read_str(form));
+                lisp::Optimizer::optimize(parsers.back());
+            }
+            lisp::Evaluator evaluator;
+            results.push_back(measure(options, name, "eval", [&] {
+                for (lisp::Parser& parser : parsers) evaluator.run(((lisp::ListNode*)parser.root)->sub_nodes[0]);
+                return parsers.size();
+            }));
+        }
+
+        // the same with a Profiler sampling the evaluator, the overhead of --profile
+        // without its per-form records
+        if (selected(options, name, "profiled")) {
+            LocalHeap local;
+            std::vector<lisp::Parser> parsers;
+            for (std::string_view form : forms) {
+                parsers.push_back(lisp::read_str(form));
+                lisp::Optimizer::optimize(parsers.back());
+            }
+            lisp::Evaluator evaluator;
+            lisp::Profiler profiler;
+            evaluator.profile(&profiler);
+            profiler.start();
+            results.push_back(measure(options, name, "profiled", [&] {
+                for (lisp::Parser& parser : parsers) evaluator.run(((lisp::ListNode*)parser.root)->sub_nodes[0]);
+                return parsers.size();
+            }));
+            profiler.stop();
+            evaluator.profile(nullptr);
+        }
+
+        if (selected(options, name, "end_to_end")) {
+            std::string path = (std::filesystem::path(options.dir) / (name + ".txt")).string();
+            {
+                std::ofstream file(path, std::ios::binary);
+                file << workload.source;
+            }
+            LocalHeap local;
+            std::ostringstream out;
+            results.push_back(measure(options, name, "end_to_end", [&] {
+                out.str("");
+                lisp::run_file(path, lisp::RunOptions(), out);
+                return forms.size();
+            }));
+        }
+    }
+
+    /* source loading */
+    // small forms, which the parser and the reader dominate once they are folded
+    bool write_large_script(const std::string& path, size_t megabytes) {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open()) return false;
+        Random random(6);
+        std::string chunk;
+        size_t written = 0;
+        while (written < megabytes << 20) {
+            chunk.clear();
+            while (chunk.size() < (1 << 20))
+                chunk += "(+ " + std::to_string(random.next(1000)) + " (* " + std::to_string(random.next(1000))
+                         + " " + std::to_string(random.next(100)) + "))\n";
+            file << chunk;
+            written += chunk.size();
+        }
+        return (bool)file;
+    }
+
+    // discards the output and records when the first result is written
+    class FirstWrite : public std::streambuf {
+    private:
+        bool written = false;
+    public:
+        std::chrono::steady_clock::time_point at;
+    protected:
+        int overflow(int c) override {
+            this->mark();
+            return traits_type::not_eof(c);
+        }
+        std::streamsize xsputn(const char*, std::streamsize n) override {
+            this->mark();
+            return n;
+        }
+    private:
+        void mark() {
+            if (this->written) return;
+            this->written = true;
+            this->at = std::chrono::steady_clock::now();
+        }
+    };
+
+#ifdef BENCH_HAS_FORK
+    struct SourceResult {
+        double first_ms = 0;        // to the first result
+        double total_ms = 0;
+        double peak_mb = 0;
+    };
+
+    // run_file in a child process, so that its peak RSS is its own
+    bool measure_source(const std::string& path, bool use_mmap, SourceResult& result) {
+        int fds[2];
+        if (::pipe(fds) != 0) return false;
+        pid_t pid = ::fork();
+        if (pid < 0) return false;
+        if (pid == 0) {
+            ::close(fds[0]);
+            lisp::RunOptions options;
+            options.use_mmap = use_mmap;
+            FirstWrite first;
+            std::ostream out(&first);
+            auto start = std::chrono::steady_clock::now();
+            int status = 0;
+            try {
+                if (!lisp::run_file(path, options, out)) status = 1;
+            } catch (const std::exception&) {
+                status = 1;
+            }
+            auto end = std::chrono::steady_clock::now();
+            double times_ms[2] = {std::chrono::duration<double, std::milli>(first.at - start).count(),
+                                  std::chrono::duration<double, std::milli>(end - start).count()};
+            if (::write(fds[1], times_ms, sizeof(times_ms)) != (ssize_t)sizeof(times_ms)) status = 1;
+            ::_exit(status);
+        }
+        ::close(fds[1]);
+        double times_ms[2] = {0, 0};
+        bool received = ::read(fds[0], times_ms, sizeof(times_ms)) == (ssize_t)sizeof(times_ms);
+        ::close(fds[0]);
+        int status = 0;
+        rusage usage;
+        if (::wait4(pid, &status, 0, &usage) != pid || !received || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            return false;
+        result.first_ms = times_ms[0];
+        result.total_ms = times_ms[1];
+#ifdef __APPLE__
+        result.peak_mb = usage.ru_maxrss / (1024.0 * 1024.0);     // bytes
+#else
+        result.peak_mb = usage.ru_maxrss / 1024.0;                // kilobytes
+#endif
+        return true;
+    }
+
+    // the rounds alternate between the readers, so that neither gets the warmer machine
+    const int SOURCE_ROUNDS = 2;
+#endif
+
+    int run_source_benchmark(const Options& options) {
+#ifdef BENCH_HAS_FORK
+        std::string path = (std::filesystem::path(options.dir) / "source_benchmark.txt").string();
+        if (!write_large_script(path, options.source_mb)) {
+            std::cerr << path << " is inaccessible.\n";
+            return -1;
+        }
+        std::cerr << std::fixed << std::setprecision(1);
+        std::cerr << "{Source} " << path << ": " << options.source_mb << " MB\n";
+        SourceResult best[2];
+        bool ok = true;
+        for (int round = 0; round < SOURCE_ROUNDS && ok; round++) {
+            for (int use_mmap = 0; use_mmap < 2 && ok; use_mmap++) {
+                SourceResult result;
+                ok = measure_source(path, use_mmap, result);
+                SourceResult& b = best[use_mmap];
+                if (round == 0 || result.total_ms < b.total_ms) b.total_ms = result.total_ms;
+                if (round == 0 || result.first_ms < b.first_ms) b.first_ms = result.first_ms;
+                if (result.peak_mb > b.peak_mb) b.peak_mb = result.peak_mb;
+            }
+        }
+        std::filesystem::remove(path);
+        if (!ok) {
+            std::cerr << "run_file failed on " << path << ".\n";
+            return 1;
+        }
+        for (int use_mmap = 0; use_mmap < 2; use_mmap++)
+            std::cerr << "{Source} " << (use_mmap ? "mmap" : "stream") << ": first result " << best[use_mmap].first_ms
+                      << " ms, total " << best[use_mmap].total_ms << " ms, peak RSS " << best[use_mmap].peak_mb << " MB\n";
+        return 0;
+#else
+        (void)options;
+        std::cerr << "--source needs fork(), which this platform does not have.\n";
+        return -1;
+#endif
+    }
+
+    /* json */
+    void write_json(std::ostream& out, const Options& options, const std::vector<Result>& results) {
+        out << "{\n  \"schema\": 1,\n  \"min_time_ms\": " << options.min_time_ms << ",\n  \"results\": [\n";
+        out << std::fixed << std::setprecision(2);
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            // one result per line, which read_baseline relies on
+            out << "    {\"workload\": \"" << r.workload << "\", \"stage\": \"" << r.stage << "\""
+                << ", \"ops\": " << r.ops << ", \"ns_per_op\": " << r.ns_per_op
+                << ", \"ops_per_sec\": " << r.ops_per_sec << ", \"items_per_op\": " << r.items_per_op
+                << ", \"objects_per_op\": " << r.objects_per_op << ", \"bytes_per_op\": " << r.bytes_per_op
+                << ", \"collections\": " << r.collections << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+
+    std::string string_field(const std::string& line, const std::string& key) {
+        size_t at = line.find("\"" + key + "\": \"");
+        if (at == std::string::npos) return "";
+        at += key.size() + 5;
+        return line.substr(at, line.find('"', at) - at);
+    }
+
+    double number_field(const std::string& line, const std::string& key) {
+        size_t at = line.find("\"" + key + "\": ");
+        if (at == std::string::npos) return 0;
+        return std::stod(line.substr(at + key.size() + 4));
+    }
+
+    // ns/op by "workload/stage" from a file written by write_json
+    bool read_baseline(const std::string& filename, std::map<std::string, double>& baseline) {
+        std::ifstream file(filename);
+        if (!file.is_open()) return false;
+        std::string line;
+        while (std::getline(file, line)) {
+            std::string workload = string_field(line, "workload");
+            if (workload.empty()) continue;
+            baseline[workload + "/" + string_field(line, "stage")] = number_field(line, "ns_per_op");
+        }
+        return true;
+    }
+
+    // prints the change of every result against the baseline; returns the number of regressions
+    size_t compare(const std::vector<Result>& results, const std::map<std::string, double>& baseline, double tolerance) {
+        size_t regressions = 0;
+        std::cerr << std::fixed << std::setprecision(1);
+        for (const Result& r : results) {
+            auto it = baseline.find(r.workload + "/" + r.stage);
+            if (it == baseline.end() || it->second <= 0) continue;
+            double change = (r.ns_per_op / it->second - 1) * 100;
+            bool regressed = change > tolerance;
+            if (regressed) regressions++;
+            std::cerr << "{Compare} " << r.workload << "/" << r.stage << ": " << (change >= 0 ? "+" : "")
+                      << change << "%" << (regressed ? " REGRESSION" : "") << "\n";
+        }
+        std::cerr << "{Compare} regressions: " << regressions << " (tolerance " << tolerance << "%)\n";
+        return regressions;
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    options.dir = std::filesystem::temp_directory_path().string();
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--json=", 0) == 0) options.json = arg.substr(7);
+        else if (arg.rfind("--baseline=", 0) == 0) options.baseline = arg.substr(11);
+        else if (arg.rfind("--tolerance=", 0) == 0) options.tolerance = std::stod(arg.substr(12));
+        else if (arg.rfind("--min-time=", 0) == 0) options.min_time_ms = std::stod(arg.substr(11));
+        else if (arg.rfind("--filter=", 0) == 0) options.filter = arg.substr(9);
+        else if (arg.rfind("--write=", 0) == 0) options.dir = arg.substr(8);
+        else if (arg.rfind("--source=", 0) == 0) options.source_mb = std::stoul(arg.substr(9));
+        else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return -1;
+        }
+    }
+    if (options.source_mb > 0) return run_source_benchmark(options);
+
+    std::map<std::string, double> baseline;
+    if (!options.baseline.empty() && !read_baseline(options.baseline, baseline)) {
+        std::cerr << options.baseline << " is inaccessible.\n";
+        return -1;
+    }
+
+    std::vector<Result> results;
+    for (const Workload& workload : workloads()) run_workload(options, workload, results);
+
+    if (options.json.empty()) {
+        write_json(std::cout, options, results);
+    } else {
+        std::ofstream json(options.json);
+        if (!json.is_open()) {
+            std::cerr << options.json << " is inaccessible.\n";
+            return -1;
+        }
+        write_json(json, options, results);
+    }
+
+    if (!options.baseline.empty() && compare(results, baseline, options.tolerance) > 0) return 1;
+    return 0;
+}
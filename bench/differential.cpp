@@ -0,0 +1,393 @@
+#include "../lisp/lisp.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// differential test of the engines: generated programs are run by run_file, as main runs
+// a script, once with the tree walker and once with the engine under test, and their
+// output and the text of their error must be the same. a program which differs is
+// written to DIR, so that `main` can be run on it again. `--jit` runs the tree walker
+// with the JIT at threshold 1, as `main --jit --jit-threshold=1`.
+//
+// usage: differential (--vm | --jit) [--seeds=N] [--first=N] [--write=DIR]
+//        differential --print [--seeds=N] [--first=N]     (writes the programs to stdout)
+
+namespace {
+
+    struct Options {
+        bool use_vm = false;
+        bool jit = false;
+        bool print = false;
+        std::uint64_t first = 1;    // seed of the first program
+        std::uint64_t seeds = 500;  // number of programs
+        std::string dir;            // where a program which differs is written
+    };
+
+    // xorshift64*, as in bench.cpp, so that a seed is the same program everywhere
+    class Random {
+    private:
+        std::uint64_t state;
+    public:
+        Random(std::uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+        std::uint32_t next(std::uint32_t bound) {
+            this->state ^= this->state >> 12;
+            this->state ^= this->state << 25;
+            this->state ^= this->state >> 27;
+            return (std::uint32_t)((this->state * 0x2545F4914F6CDD1Dull) >> 32) % bound;
+        }
+        bool chance(std::uint32_t percent) { return this->next(100) < percent; }
+    };
+
+    /* programs */
+    // random forms over the globals and functions defined before them. most operands are
+    // Ints, and a few percent are of another type, undefined or of the wrong arity, so that
+    // a program may end in any error of the engines.
+    class Generator {
+    private:
+        Random random;
+        std::uint32_t faults;               // percent of the operands which are wrong
+        std::vector<std::string> globals;   // Ints
+        std::vector<std::pair<std::string, int>> functions;    // name, arity
+        std::vector<std::string> loops;     // (name count acc), called with small counts only
+        int names = 0;
+        bool in_function = false;           // a body calls no function, so that every call is cheap
+
+        std::string fresh(const char* prefix) { return prefix + std::to_string(this->names++); }
+
+        std::string integer() {
+            switch (this->random.next(200)) {
+            case 0: return std::to_string(2147483647 - (int)this->random.next(3));
+            case 1: return std::to_string(-2147483647 - (int)this->random.next(2));
+            case 2: case 3: case 4: case 5: case 6: case 7: return "0";
+            default: return std::to_string((int)this->random.next(40) - 10);
+            }
+        }
+
+        std::string wrong() {
+            switch (this->random.next(7)) {
+            case 0: return "\"s\"";
+            case 1: return "'c'";
+            case 2: return "null";
+            case 3: return "true";
+            case 4: return "(list 1 2)";
+            case 5: return "undefined-name";
+            default: return "(vec 1 2)";
+            }
+        }
+
+        // an index of a collection of `size` elements, out of range when it is wrong
+        std::string index(std::uint32_t size) {
+            if (this->random.chance(this->faults)) return this->random.next(2) ? std::to_string(size) : "-1";
+            return std::to_string(this->random.next(size));
+        }
+
+        std::string leaf(const std::vector<std::string>& locals) {
+            if (this->random.chance(this->faults)) return this->wrong();
+            std::uint32_t kind = this->random.next(10);
+            if (kind < 4 && !locals.empty()) return locals[this->random.next((std::uint32_t)locals.size())];
+            if (kind < 6 && !this->globals.empty()) return this->globals[this->random.next((std::uint32_t)this->globals.size())];
+            return this->integer();
+        }
+
+        std::string operands(int count, int depth, std::vector<std::string>& locals) {
+            std::string out;
+            for (int i = 0; i < count; i++) out += " " + this->expression(depth - 1, locals);
+            return out;
+        }
+
+        // an expression of lists the JIT compiles: + - * / = < over locals and small
+        // literals, under if and let*. a quotient is by `divisor` or a literal which is not 0
+        std::string compiled(int depth, std::vector<std::string>& locals, const std::string& divisor) {
+            if (depth <= 0 || this->random.chance(15)) {
+                if (this->random.chance(60)) return locals[this->random.next((std::uint32_t)locals.size())];
+                return std::to_string((int)this->random.next(20) - 5);
+            }
+            switch (this->random.next(8)) {
+            case 0:
+                return "(if (" + std::string(this->random.next(2) ? "<" : "=") + " " + this->compiled(depth - 1, locals, divisor)
+                       + " " + this->compiled(depth - 1, locals, divisor) + ") " + this->compiled(depth - 1, locals, divisor)
+                       + " " + this->compiled(depth - 1, locals, divisor) + ")";
+            case 1: {
+                std::string name = this->fresh("v");
+                std::string out = "(let* (" + name + " " + this->compiled(depth - 1, locals, divisor) + ") ";
+                locals.push_back(name);
+                out += this->compiled(depth - 1, locals, divisor) + ")";
+                locals.pop_back();
+                return out;
+            }
+            case 2:
+                return "(* " + this->compiled(depth - 1, locals, divisor) + " " + std::to_string(this->random.next(4)) + ")";
+            case 3:
+                return "(/ " + this->compiled(depth - 1, locals, divisor) + " "
+                       + (this->random.next(2) ? divisor : std::to_string(1 + this->random.next(5))) + ")";
+            default: {
+                std::string out = this->random.next(2) ? "(+" : "(-";
+                int count = 2 + (int)this->random.next(2);
+                for (int i = 0; i < count; i++) out += " " + this->compiled(depth - 1, locals, divisor);
+                return out + ")";
+            }
+            }
+        }
+
+        // a function of compiled lists, and a loop which calls it with Ints until its lists
+        // are hot and sums its results in a compiled list too; then the function or the loop
+        // is called once more, with operands which may overflow, divide by zero or not be Ints
+        std::string hot() {
+            std::string function = this->fresh("h"), loop = this->fresh("r");
+            std::string x = this->fresh("p"), y = this->fresh("p"), n = this->fresh("p"), acc = this->fresh("p");
+            std::string v = this->fresh("v");
+            std::vector<std::string> locals = {x, y};
+            std::string body = "(- " + this->compiled(3, locals, y) + " (/ " + x + " " + y + "))";
+            std::string step = std::to_string(1 + this->random.next(5));
+            std::string out = "(def! " + function + " (fn* (" + x + " " + y + ") " + body + "))\n"
+                              "(def! " + loop + " (fn* (" + n + " " + acc + ") (if (< " + n + " 1) " + acc + " (let* (" + v
+                              + " (" + function + " " + n + " " + step + ")) (" + loop + " (- " + n + " 1) (+ " + acc + " " + v
+                              + "))))))\n"
+                              "(" + loop + " " + std::to_string(10 + this->random.next(20)) + " 0)\n";
+            this->functions.push_back({function, 2});
+            this->loops.push_back(loop);
+
+            std::string lhs = std::to_string(this->random.next(30)), rhs = step;
+            switch (this->random.next(8)) {
+            case 0:
+                lhs = this->random.next(2) ? std::to_string(2147483647 - (int)this->random.next(3)) : "-2147483648";
+                rhs = this->random.next(2) ? "-1" : step;
+                break;
+            case 1: rhs = "0"; break;
+            case 2: (this->random.next(2) ? lhs : rhs) = this->wrong(); break;
+            case 3:
+                // the sum of the loop overflows
+                return out + "(" + loop + " " + std::to_string(10 + this->random.next(20)) + " "
+                       + std::to_string(2147483647 - (int)this->random.next(50)) + ")";
+            default: break;
+            }
+            return out + "(" + function + " " + lhs + " " + rhs + ")";
+        }
+
+    public:
+        Generator(std::uint64_t seed) : random(seed) {
+            // half of the programs run without wrong operands, until overflow or division by zero
+            this->faults = this->random.next(2) == 0 ? 0 : 1 + this->random.next(2);
+        }
+
+        // an expression which is an Int unless something is wrong
+        std::string expression(int depth, std::vector<std::string>& locals) {
+            if (depth <= 0) return this->leaf(locals);
+            switch (this->random.next(16)) {
+            case 0: case 1: case 2: case 3: {
+                const char* ops[] = {"+", "+", "-", "-", "*", "/"};
+                const char* op = ops[this->random.next(6)];
+                // products of products overflow soon, so most factors are small literals
+                if (op[0] == '*' && this->random.chance(80))
+                    return "(* " + this->expression(depth - 1, locals) + " " + std::to_string(this->random.next(5)) + ")";
+                int count = (int)this->random.next(4) + (this->random.chance(95) ? 1 : 0);
+                return std::string("(") + op + this->operands(count, depth, locals) + ")";
+            }
+            case 4:
+                return "(if (" + std::string(this->random.next(2) ? "<" : "=") + this->operands(2, depth, locals) + ")"
+                       + this->operands(2, depth, locals) + ")";
+            case 5: case 6: {
+                std::string out = "(let* (";
+                size_t before = locals.size();
+                int count = 1 + (int)this->random.next(3);
+                for (int i = 0; i < count; i++) {
+                    std::string name = this->fresh("v");
+                    out += (i == 0 ? "" : " ") + name + " " + this->expression(depth - 1, locals);
+                    locals.push_back(name);
+                }
+                out += ") " + this->expression(depth - 1, locals) + ")";
+                locals.resize(before);
+                return out;
+            }
+            case 7:
+                if (!this->functions.empty() && !this->in_function) {
+                    auto& function = this->functions[this->random.next((std::uint32_t)this->functions.size())];
+                    int arity = function.second;
+                    if (this->random.chance(this->faults)) arity += this->random.next(2) ? 1 : -1;
+                    if (arity < 0) arity = 0;
+                    return "(" + function.first + this->operands(arity, depth, locals) + ")";
+                }
+                return this->leaf(locals);
+            case 8:
+                return "(count (list" + this->operands((int)this->random.next(4), depth, locals) + "))";
+            case 9:
+                return "(get (vector" + this->operands(3, depth, locals) + ") " + this->index(3) + ")";
+            case 10:
+                return "(vec-sum (vec" + this->operands(1 + (int)this->random.next(3), depth, locals) + "))";
+            case 11:
+                return "(vec-get (vec* (vec-range 5) " + this->expression(depth - 1, locals) + ") " + this->index(5) + ")";
+            case 12:
+                return "(first (list" + this->operands(1 + (int)this->random.next(2), depth, locals) + "))";
+            case 13:
+                if (!this->loops.empty() && !this->in_function)
+                    return "(" + this->loops[this->random.next((std::uint32_t)this->loops.size())] + " "
+                           + std::to_string(this->random.next(30)) + this->operands(1, depth, locals) + ")";
+                return this->leaf(locals);
+            default:
+                return this->leaf(locals);
+            }
+        }
+
+        // a top-level form is a list
+        std::string list(int depth, std::vector<std::string>& locals) {
+            std::string out;
+            do {
+                out = this->expression(depth, locals);
+            } while (out[0] != '(');
+            return out;
+        }
+
+        // a global, a function, a recursive function, hot lists or an expression
+        std::string form() {
+            std::vector<std::string> locals;
+            switch (this->random.next(9)) {
+            case 0: case 1: {
+                std::string value = this->expression(3, locals);
+                std::string name = this->fresh("g");
+                this->globals.push_back(name);
+                return "(def! " + name + " " + value + ")";
+            }
+            case 2: {
+                std::string name = this->fresh("f");
+                int arity = 1 + (int)this->random.next(3);
+                std::string params;
+                for (int i = 0; i < arity; i++) {
+                    locals.push_back(this->fresh("p"));
+                    params += (i == 0 ? "" : " ") + locals.back();
+                }
+                this->in_function = true;
+                std::string body = this->expression(3, locals);
+                this->in_function = false;
+                this->functions.push_back({name, arity});
+                return "(def! " + name + " (fn* (" + params + ") " + body + "))";
+            }
+            case 3: {
+                // a loop in tail calls, run a few times
+                std::string name = this->fresh("r");
+                std::string n = this->fresh("p"), acc = this->fresh("p");
+                locals = {n, acc};
+                this->in_function = true;
+                std::string step = this->expression(2, locals);
+                this->in_function = false;
+                this->loops.push_back(name);
+                return "(def! " + name + " (fn* (" + n + " " + acc + ") (if (< " + n + " 1) " + acc + " (" + name
+                       + " (- " + n + " 1) (+ " + acc + " " + step + ")))))";
+            }
+            case 4:
+                if (!this->functions.empty()) {
+                    auto& function = this->functions[this->random.next((std::uint32_t)this->functions.size())];
+                    if (function.second == 1)
+                        return "(pmap " + function.first + " (list" + this->operands(3, 2, locals) + "))";
+                }
+                return this->list(3, locals);
+            case 5:
+                return this->hot();
+            default:
+                return this->list(3, locals);
+            }
+        }
+
+        std::string program() {
+            std::string source;
+            int count = 5 + (int)this->random.next(20);
+            for (int i = 0; i < count; i++) source += this->form() + "\n";
+            return source;
+        }
+    };
+
+    /* runs */
+    struct Run {
+        std::string output;
+        std::string error;      // what() of the error which ended the script, if any
+    };
+
+    Run run(const std::string& path, const lisp::RunOptions& options) {
+        Run result;
+        std::ostringstream out;
+        try {
+            if (!lisp::run_file(path, options, out)) result.error = path + " is inaccessible.";
+        } catch (const std::exception& error) {
+            result.error = error.what();
+        }
+        result.output = out.str();
+        return result;
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    options.dir = std::filesystem::temp_directory_path().string();
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--vm") options.use_vm = true;
+        else if (arg == "--jit") options.jit = true;
+        else if (arg == "--print") options.print = true;
+        else if (arg.rfind("--seeds=", 0) == 0) options.seeds = std::stoull(arg.substr(8));
+        else if (arg.rfind("--first=", 0) == 0) options.first = std::stoull(arg.substr(8));
+        else if (arg.rfind("--write=", 0) == 0) options.dir = arg.substr(8);
+        else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return -1;
+        }
+    }
+    if (options.print) {
+        for (std::uint64_t seed = options.first; seed < options.first + options.seeds; seed++)
+            std::cout << "; seed " << seed << "\n" << Generator(seed).program();
+        return 0;
+    }
+    if (options.use_vm == options.jit) {
+        std::cerr << "usage: differential (--vm | --jit) [--seeds=N] [--first=N] [--write=DIR]\n"
+                     "       differential --print [--seeds=N] [--first=N]\n";
+        return -1;
+    }
+
+    lisp::RunOptions reference;
+    lisp::RunOptions tested;
+    tested.use_vm = options.use_vm;
+    tested.jit = options.jit;
+    const char* engine = options.jit ? "jit" : "vm";
+    // every list the JIT takes is compiled at its first run, and then runs compiled
+    if (options.jit) {
+        if (!lisp::Jit::supported()) std::cerr << "{Diff} the JIT is not supported on this platform\n";
+        lisp::Jit::set_threshold(1);
+    }
+
+    std::string path = (std::filesystem::path(options.dir) / "differential.txt").string();
+    size_t mismatches = 0;
+    size_t completed = 0;                   // programs which ran to the end
+    std::map<std::string, size_t> errors;   // by message, so that the errors reached are seen
+    for (std::uint64_t seed = options.first; seed < options.first + options.seeds; seed++) {
+        std::string source = Generator(seed).program();
+        {
+            std::ofstream file(path, std::ios::binary);
+            file << source;
+        }
+        Run expected = run(path, reference);
+        Run actual = run(path, tested);
+        if (expected.error.empty()) completed++;
+        else errors[expected.error.substr(0, expected.error.find(" (line"))]++;
+        if (expected.output == actual.output && expected.error == actual.error) continue;
+
+        mismatches++;
+        std::string kept = (std::filesystem::path(options.dir) / ("differential-" + std::to_string(seed) + ".txt")).string();
+        std::filesystem::copy_file(path, kept, std::filesystem::copy_options::overwrite_existing);
+        std::cerr << "{Diff} seed " << seed << ": " << kept << "\n"
+                  << "  walker: " << expected.error << "\n  " << engine << ": " << actual.error << "\n";
+        if (expected.output != actual.output) std::cerr << "  output differs\n";
+    }
+    std::filesystem::remove(path);
+
+    for (const auto& error : errors) std::cerr << "{Diff} " << error.second << " x " << error.first << "\n";
+    // bailouts show that lists went hot before they failed
+    if (options.jit) lisp::Jit::print_stats(std::cerr);
+    std::cerr << "{Diff} " << engine << ": programs: " << options.seeds << ", without error: " << completed
+              << ", mismatches: " << mismatches << "\n";
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+#include "../lisp/lisp.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// a load test of a running server (main --serve=PATH): every client is a thread with one
+// connection, sending the same request again and again and waiting for each response.
+// the latency of every request is kept, and the percentiles are taken over all clients.
+//
+// usage: loadtest --socket=PATH [--clients=N] [--requests=N] [--warmup=N]
+//                 [--file=FILE | --source=TEXT] [--json=FILE]
+
+namespace {
+
+    struct Options {
+        std::string socket;
+        std::string source = "(+ 1 2)";
+        std::string json;
+        size_t clients = 4;
+        size_t requests = 1000;     // of each client
+        size_t warmup = 10;         // requests of each client before the measured ones
+    };
+
+    struct Client {
+        std::vector<double> latencies_us;
+        size_t errors = 0;          // responses with the error status
+        bool broken = false;        // the connection failed or was closed by the server
+    };
+
+    void run_client(const Options& options, Client& client, std::atomic<size_t>& ready, size_t total) {
+        int fd = lisp::connect_server(options.socket);
+        if (fd < 0) {
+            client.broken = true;
+            ready++;
+            return;
+        }
+        bool ok;
+        std::string output;
+        for (size_t i = 0; i < options.warmup && !client.broken; i++)
+            if (!lisp::write_request(fd, options.source) || !lisp::read_response(fd, ok, output)) client.broken = true;
+        // every client starts measuring once all of them are warm
+        ready++;
+        while (ready.load() < total) std::this_thread::yield();
+
+        client.latencies_us.reserve(options.requests);
+        for (size_t i = 0; i < options.requests && !client.broken; i++) {
+            auto start = std::chrono::steady_clock::now();
+            if (!lisp::write_request(fd, options.source) || !lisp::read_response(fd, ok, output)) {
+                client.broken = true;
+                break;
+            }
+            client.latencies_us.push_back(
+                std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+            if (!ok) client.errors++;
+        }
+        lisp::close_connection(fd);
+    }
+
+    // nearest rank of a sorted list
+    double percentile(const std::vector<double>& sorted, double p) {
+        if (sorted.empty()) return 0;
+        size_t rank = (size_t)(p / 100 * sorted.size() + 0.5);
+        return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--socket=", 0) == 0) options.socket = arg.substr(9);
+        else if (arg.rfind("--clients=", 0) == 0) options.clients = std::stoul(arg.substr(10));
+        else if (arg.rfind("--requests=", 0) == 0) options.requests = std::stoul(arg.substr(11));
+        else if (arg.rfind("--warmup=", 0) == 0) options.warmup = std::stoul(arg.substr(9));
+        else if (arg.rfind("--source=", 0) == 0) options.source = arg.substr(9);
+        else if (arg.rfind("--json=", 0) == 0) options.json = arg.substr(7);
+        else if (arg.rfind("--file=", 0) == 0) {
+            std::ifstream file(arg.substr(7));
+            if (!file.is_open()) {
+                std::cerr << arg.substr(7) << " is inaccessible.\n";
+                return -1;
+            }
+            std::stringstream source;
+            source << file.rdbuf();
+            options.source = source.str();
+        }
+        else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return -1;
+        }
+    }
+    if (options.socket.empty() || options.clients == 0) {
+        std::cerr << "usage: loadtest --socket=PATH [--clients=N] [--requests=N] [--warmup=N] "
+                     "[--file=FILE | --source=TEXT] [--json=FILE]\n";
+        return -1;
+    }
+
+    std::vector<Client> clients(options.clients);
+    std::vector<std::thread> threads;
+    std::atomic<size_t> ready{0};
+    for (Client& client : clients)
+        threads.emplace_back(run_client, std::cref(options), std::ref(client), std::ref(ready), options.clients);
+    // the clock starts when the last client is warm, as theirs do
+    while (ready.load() < options.clients) std::this_thread::yield();
+    auto start = std::chrono::steady_clock::now();
+    for (std::thread& thread : threads) thread.join();
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> latencies;
+    size_t errors = 0, broken = 0;
+    for (const Client& client : clients) {
+        latencies.insert(latencies.end(), client.latencies_us.begin(), client.latencies_us.end());
+        errors += client.errors;
+        if (client.broken) broken++;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (double latency : latencies) mean += latency;
+    if (!latencies.empty()) mean /= latencies.size();
+    double throughput = elapsed_s > 0 ? latencies.size() / elapsed_s : 0;
+
+    std::cerr << std::fixed << std::setprecision(1);
+    std::cerr << "{Load} " << options.socket << ": " << options.clients << " clients, " << latencies.size()
+              << " requests in " << elapsed_s * 1000 << " ms, errors: " << errors << ", broken connections: "
+              << broken << "\n";
+    std::cerr << "{Load} throughput: " << throughput << " req/s\n";
+    std::cerr << "{Load} latency us: p50 " << percentile(latencies, 50) << ", p99 " << percentile(latencies, 99)
+              << ", max " << (latencies.empty() ? 0 : latencies.back()) << ", mean " << mean << "\n";
+
+    if (!options.json.empty()) {
+        std::ofstream file(options.json);
+        if (!file.is_open()) {
+            std::cerr << options.json << " is inaccessible.\n";
+            return -1;
+        }
+        file << std::fixed << std::setprecision(2);
+        file << "{\n  \"schema\": 1,\n  \"clients\": " << options.clients << ",\n  \"requests\": " << latencies.size()
+             << ",\n  \"errors\": " << errors << ",\n  \"broken\": " << broken << ",\n  \"req_per_sec\": "
+             << throughput << ",\n  \"p50_us\": " << percentile(latencies, 50) << ",\n  \"p99_us\": "
+             << percentile(latencies, 99) << ",\n  \"max_us\": " << (latencies.empty() ? 0 : latencies.back())
+             << ",\n  \"mean_us\": " << mean << "\n}\n";
+    }
+    return broken > 0 ? 1 : 0;
+}
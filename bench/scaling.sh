@@ -0,0 +1,14 @@
+#!/bin/sh
+# runs bench/parallel.txt with 1, 2, 4, ... threads up to N (default: number of cores)
+# usage: bench/scaling.sh ./build/Release/main [N]
+main=${1:-./build/Release/main}
+max=${2:-$(nproc)}
+dir=$(dirname "$0")
+threads=1
+while [ "$threads" -le "$max" ]; do
+    start=$(date +%s%N)
+    "$main" --threads="$threads" "$dir/parallel.txt" > /dev/null || exit 1
+    end=$(date +%s%N)
+    echo "threads=$threads $(( (end - start) / 1000000 )) ms"
+    if [ "$threads" -lt "$max" ] && [ $((threads * 2)) -gt "$max" ]; then threads=$max; else threads=$((threads * 2)); fi
+done
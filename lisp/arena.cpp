@@ -0,0 +1,45 @@
+#include "arena.hpp"
+
+#include <cstdint>
+
+namespace lisp {
+
+    /* Arena */
+    Arena::Arena(size_t block_size) : block_size(block_size) {}
+
+    Arena::~Arena() {
+        this->release();
+    }
+
+    void* Arena::allocate(size_t size, size_t align) {
+        size_t padding = (align - (uintptr_t)this->cursor % align) % align;
+        if (this->cursor == nullptr || padding + size > this->remaining) {
+            // objects larger than a block get a block of their own
+            size_t capacity = size + align > this->block_size ? size + align : this->block_size;
+            this->blocks.emplace_back(new unsigned char[capacity]);
+            this->cursor = this->blocks.back().get();
+            this->remaining = capacity;
+            padding = (align - (uintptr_t)this->cursor % align) % align;
+        }
+        void* ptr = this->cursor + padding;
+        this->cursor += padding + size;
+        this->remaining -= padding + size;
+        this->used += size;
+        return ptr;
+    }
+
+    void Arena::release() {
+        for (auto it = this->finalizers.rbegin(); it != this->finalizers.rend(); it++)
+            it->destroy(it->object);
+        this->finalizers.clear();
+        this->blocks.clear();
+        this->cursor = nullptr;
+        this->remaining = 0;
+        this->used = 0;
+    }
+
+    size_t Arena::bytes_used() const {
+        return this->used;
+    }
+
+} // namespace lisp
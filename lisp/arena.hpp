@@ -0,0 +1,54 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lisp {
+
+    // bump allocator; every object made here is destroyed at once by release() or ~Arena().
+    class Arena {
+    private:
+        struct Finalizer {
+            void (*destroy)(void*);
+            void* object;
+        };
+
+        std::vector<std::unique_ptr<unsigned char[]>> blocks;
+        std::vector<Finalizer> finalizers;
+        unsigned char* cursor = nullptr;
+        size_t remaining = 0;
+        size_t block_size;
+        size_t used = 0;
+
+        template <typename T>
+        static void destroy(void* object) {
+            static_cast<T*>(object)->~T();
+        }
+
+    public:
+        Arena(size_t block_size = 4096);
+        ~Arena();
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        void* allocate(size_t size, size_t align);
+        void release();
+        size_t bytes_used() const;
+
+        template <typename T, typename... Args>
+        T* make(Args&&... args) {
+            T* object = new (this->allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            if (!std::is_trivially_destructible<T>::value)
+                this->finalizers.push_back({&Arena::destroy<T>, object});
+            return object;
+        }
+    };
+
+} // namespace lisp
+
+#endif
@@ -0,0 +1,62 @@
+#include "arithmetic.hpp"
+
+#include <climits>
+
+namespace lisp {
+
+    // branch-free loops over the operands, so that the compiler can vectorize them
+    static bool all_int(const Value* argv, size_t argc) {
+        bool result = true;
+        for (size_t i = 0; i < argc; i++)
+            result &= argv[i].is_int();
+        return result;
+    }
+
+    // exact, as fewer than 2^32 Int operands never overflow 64 bits
+    static long long sum(const Value* argv, size_t argc) {
+        long long result = 0;
+        for (size_t i = 0; i < argc; i++)
+            result += argv[i].as_int();
+        return result;
+    }
+
+    static long long product(const Value* argv, size_t argc) {
+        long long result = 1;
+        for (size_t i = 0; i < argc; i++) {
+            // |result| only grows once it leaves Int, unless a later operand is 0
+            if (argv[i].as_int() == 0) return 0;
+            if (result >= INT_MIN && result <= INT_MAX) result *= argv[i].as_int();
+        }
+        return result;
+    }
+
+    // false on division by zero
+    static bool quotient(const Value* argv, size_t argc, long long& result) {
+        result = argc == 1 ? 1 : argv[0].as_int();
+        for (size_t i = argc == 1 ? 0 : 1; i < argc; i++) {
+            if (argv[i].as_int() == 0) return false;
+            result /= argv[i].as_int();
+        }
+        return true;
+    }
+
+    Value arithmetic(SymbolId oper, const Value* argv, size_t argc) {
+        if (!all_int(argv, argc))
+            return fail(ErrorCode::Operator, "[operator error] Data type of operand is not Int.");
+
+        long long result;
+        switch (oper) {
+        case SYM_ADD: result = sum(argv, argc); break;
+        case SYM_SUB: result = argc == 1 ? -(long long)argv[0].as_int() : argv[0].as_int() - sum(argv + 1, argc - 1); break;
+        case SYM_MUL: result = product(argv, argc); break;
+        default:
+            if (!quotient(argv, argc, result))
+                return fail(ErrorCode::Operator, "[operator error] Division by zero.");
+            break;
+        }
+        if (result < INT_MIN || result > INT_MAX)
+            return fail(ErrorCode::Operator, "[operator error] Integer overflow.");
+        return Value::integer((int)result);
+    }
+
+} // namespace lisp
@@ -0,0 +1,20 @@
+#ifndef ARITHMETIC_HPP
+#define ARITHMETIC_HPP
+
+#include "error.hpp"
+#include "symbol.hpp"
+#include "value.hpp"
+
+#include <cstddef>
+
+namespace lisp {
+
+    // `+ - * /` (SYM_ADD to SYM_DIV) over `argc` operands, shared by Evaluator, VM and Optimizer.
+    // (+) is 0, (*) is 1, (- x) is -x and (/ x) is 1 / x; `-` and `/` need at least one operand.
+    // every operand must be Int, and the exact result must fit in Int; otherwise a failure
+    // (Value::failure()) with the error pending.
+    Value arithmetic(SymbolId oper, const Value* argv, size_t argc);
+
+} // namespace lisp
+
+#endif
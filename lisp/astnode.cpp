@@ -1,85 +1,107 @@
 #include "astnode.hpp"
+#include "heap.hpp"
+#include "jit.hpp"
 
 #include <iostream>
 #include <typeinfo>
 
 namespace lisp {
 
+    const char* kind_name(NodeKind kind) {
+        switch (kind) {
+            case NodeKind::Literal: return "Literal";
+            case NodeKind::Symbol: return "Symbol";
+            case NodeKind::List: return "List";
+            case NodeKind::Function: return "Function";
+        }
+        return "Unknown";
+    }
+
     /* LiteralNode */
-    LiteralNode::LiteralNode(int value) {
+    LiteralNode::LiteralNode(int value) : ASTNode(NodeKind::Literal) {
         this->literal = value;
-        this->type = "Literal";
+        this->hold();
     }
-    LiteralNode::LiteralNode(char value) {
+    LiteralNode::LiteralNode(char value) : ASTNode(NodeKind::Literal) {
         this->literal = value;
-        this->type = "Literal";
+        this->hold();
     }
-    LiteralNode::LiteralNode(std::string value) {
+    LiteralNode::LiteralNode(std::string value) : ASTNode(NodeKind::Literal) {
         this->literal = value;
-        this->type = "Literal";
+        this->hold();
     }
-    LiteralNode::LiteralNode(bool value) {
+    LiteralNode::LiteralNode(bool value) : ASTNode(NodeKind::Literal) {
         this->literal = value;
-        this->type = "Literal";
+        this->hold();
     }
-    LiteralNode::LiteralNode(std::nullptr_t value) {
+    LiteralNode::LiteralNode(std::nullptr_t value) : ASTNode(NodeKind::Literal) {
         this->literal = value;
-        this->type = "Literal";
+        this->hold();
     }
-    LiteralNode::LiteralNode(Literal value) {
+    LiteralNode::LiteralNode(Literal value) : ASTNode(NodeKind::Literal) {
         this->literal = value;
-        this->type = "Literal";
+        this->hold();
     }
 
-    void LiteralNode::print() const {
-        std::visit([](const auto& val) {
+    void LiteralNode::hold() {
+        this->value = Value(this->literal);
+        heap().pin(this->value);
+    }
+
+    LiteralNode::~LiteralNode() {
+        heap().unpin(this->value);
+    }
+
+    void LiteralNode::print(std::ostream& out) const {
+        std::visit([&out](const auto& val) {
             if constexpr (std::is_same_v<std::decay_t<decltype(val)>, std::nullptr_t>) {
-                std::cout << "[LiteralNode] nullptr\n";
+                out << "[LiteralNode] nullptr\n";
             } else {
-                std::cout << "[LiteralNode] " << val << " (" << typeid(val).name() << ")\n";
+                out << "[LiteralNode] " << val << " (" << typeid(val).name() << ")\n";
             }
         }, literal);
     }
 
     /* SymbolNode */
-    SymbolNode::SymbolNode(std::string symbol) {
-        this->symbol_name = symbol;
-        this->type = "Symbol"; 
+    SymbolNode::SymbolNode(std::string_view symbol) : ASTNode(NodeKind::Symbol) {
+        this->symbol_id = intern(symbol);
+    }
+    SymbolNode::SymbolNode(SymbolId id) : ASTNode(NodeKind::Symbol) {
+        this->symbol_id = id;
     }
 
-    void SymbolNode::print() const {
-        std::cout << "[SymbolNode] " << symbol_name << "\n";
+    void SymbolNode::print(std::ostream& out) const {
+        out << "[SymbolNode] " << symbol_name(symbol_id) << "\n";
     }
 
     /* ListNode */
-    ListNode::ListNode(std::vector<ASTNode*> vec_nodes) {
-        this->type = "List";
-        this->sub_nodes = vec_nodes;
+    ListNode::ListNode(std::vector<ASTNode*> vec_nodes) : ASTNode(NodeKind::List) {
+        this->sub_nodes = std::move(vec_nodes);
     }
 
-    void ListNode::print() const {
-        std::cout << "[ListNode] ";
+    ListNode::~ListNode() {
+        if (this->native != nullptr) Jit::release(this->native);
+    }
+
+    void ListNode::print(std::ostream& out) const {
+        out << "[ListNode] ";
         for (ASTNode* node_ptr : sub_nodes) {
-            std::cout << node_ptr->type << " ";
+            out << kind_name(node_ptr->kind) << " ";
         }
-        std::cout << "(End)\n";
+        out << "(End)\n";
     }
 
     /* FunctionNode */
-    FunctionNode::FunctionNode(std::vector<lisp::SymbolNode> parameters, std::vector<lisp::ASTNode*> codes) {
-        this->type = "Function";
-        this->parameters = std::unordered_map<std::string, ASTNode*>();
-        for (auto symbol_node : parameters) {
-            this->parameters.insert({symbol_node.symbol_name, new LiteralNode((int)0)});
-        }
-        this->codes = codes;
+    FunctionNode::FunctionNode(std::vector<SymbolId> parameters, ASTNode* body) : ASTNode(NodeKind::Function) {
+        this->parameters = std::move(parameters);
+        this->body = body;
     }
 
-    void FunctionNode::print() const {
-        std::cout << "[FunctionNode] func( ";
-        for (auto it = parameters.begin(); it != parameters.end(); it++)
-            std::cout << it->first << " ";
-        std::cout << ")\n";
+    void FunctionNode::print(std::ostream& out) const {
+        out << "[FunctionNode] func( ";
+        for (SymbolId parameter : parameters)
+            out << symbol_name(parameter) << " ";
+        out << ")\n";
     }
 
 } // namespace lisp
\ No newline at end of file
@@ -1,56 +1,99 @@
 #ifndef ASTNODE_HPP
 #define ASTNODE_HPP
 
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
 #include <string>
 #include <vector>
 #include <variant>
 #include <unordered_map>
 
+#include "error.hpp"
+#include "symbol.hpp"
+#include "value.hpp"
+
 namespace lisp {
 
+    // one-byte tag stored right after the vtable pointer, so that the kind
+    // check and the payload of each subclass share the first cache line.
+    enum class NodeKind : std::uint8_t { Literal, Symbol, List, Function };
+
+    const char* kind_name(NodeKind kind);
+
     class ASTNode {
     public:
-        std::string type;
+        NodeKind kind;
+        // where the node starts; set by the Parser, unknown (line 0) in nodes of an image
+        SourcePosition position;
         virtual ~ASTNode() = default;
-        virtual void print() const = 0;
+        virtual void print(std::ostream& out) const = 0;
+    protected:
+        ASTNode(NodeKind kind) : kind(kind) {}
     };
 
-    typedef std::variant<int, char, std::string, bool, std::nullptr_t> Literal;
-
+    // pins its `value`, so that literal strings stay alive as long as the AST.
     class LiteralNode : public ASTNode {
     private:
+        void hold();
     public:
         Literal literal;
+        Value value;    // runtime form of `literal`, built once by the parser
         LiteralNode(int value);
         LiteralNode(char value);
         LiteralNode(std::string value);
         LiteralNode(bool value);
         LiteralNode(std::nullptr_t value);
         LiteralNode(Literal value);
-        void print() const override;
+        ~LiteralNode() override;
+        void print(std::ostream& out) const override;
     };
 
     class SymbolNode : public ASTNode {
     public:
-        std::string symbol_name;
-        SymbolNode(std::string symbol);
-        void print() const override;
+        SymbolId symbol_id;
+        // lexical address filled by Resolver; depth < 0 means a global symbol.
+        int depth = -1;
+        int slot = 0;
+        // where a global symbol was last found; shared by the Evaluator and the VM
+        GlobalCache global;
+        SymbolNode(std::string_view symbol);
+        SymbolNode(SymbolId id);
+        void print(std::ostream& out) const override;
     };
 
+    struct JitCode;
+
     class ListNode : public ASTNode {
     public:
         std::vector<ASTNode*> sub_nodes;
+        // counted and compiled by the JIT of the root Evaluator only; see jit.hpp
+        std::uint32_t hits = 0;
+        JitCode* native = nullptr;
         ListNode(std::vector<ASTNode*> vec_nodes);
-        void print() const override;
+        ~ListNode();
+        void print(std::ostream& out) const override;
     };
 
+    class Chunk;
+
+    // a well-formed (fn* (parameters...) body); made by the parser in place of its ListNode.
     class FunctionNode : public ASTNode {
     private:
     public:
-        std::unordered_map<std::string, ASTNode*> parameters;
-        std::vector<ASTNode*> codes;
-        FunctionNode(std::vector<lisp::SymbolNode> parameters, std::vector<lisp::ASTNode*> codes);
-        void print() const override;
+        std::vector<SymbolId> parameters;
+        ASTNode* body;
+        // filled by Resolver: address at the fn* site of each captured local.
+        // inside the body, i-th capture is the slot right after the parameters.
+        std::vector<std::pair<int, int>> captures;
+        // bytecode of the body, compiled when a VM first calls the function
+        std::shared_ptr<Chunk> chunk;
+        // label of the function in the Profiler; 0 until it is profiled
+        std::uint32_t profile_label = 0;
+        // CodeObject owning the arena of this node; set by Evaluator::retain
+        Object* owner = nullptr;
+        FunctionNode(std::vector<SymbolId> parameters, ASTNode* body);
+        void print(std::ostream& out) const override;
     };
     
 } // namespace lisp
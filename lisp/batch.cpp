@@ -0,0 +1,282 @@
+#include "batch.hpp"
+
+#include "cache.hpp"
+#include "error.hpp"
+#include "evaluator.hpp"
+#include "heap.hpp"
+#include "image.hpp"
+#include "optimizer.hpp"
+#include "parser.hpp"
+#include "profiler.hpp"
+#include "reader.hpp"
+#include "source.hpp"
+#include "vm.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <typeinfo>
+
+namespace lisp {
+
+    static void __write_profile(Profiler& profiler, const std::string& filename) {
+        profiler.stop();
+        profiler.print(std::cerr);
+        std::ofstream folded(filename);
+        if (!folded.is_open())
+            throw SyntaxError(ErrorCode::Profile, "[profile error] Profile file is inaccessible.");
+        profiler.print_folded(folded);
+    }
+
+    // a cached form keeps the positions of the place it was first parsed at, `first`;
+    // a position within it is moved to where the same text is now, `now`.
+    static SourcePosition __relocate(SourcePosition position, std::string_view code,
+                                     SourcePosition first, SourcePosition now) {
+        size_t last_line = code.rfind('\n');
+        std::uint32_t lines = (std::uint32_t)std::count(code.begin(), code.end(), '\n');
+        std::uint32_t end = last_line == std::string_view::npos ? first.column + (std::uint32_t)code.size()
+                                                                : (std::uint32_t)(code.size() - last_line);
+        if (position.line < first.line || position.line > first.line + lines) return position;
+        if (position.line == first.line && position.column < first.column) return position;
+        if (position.line == first.line + lines && position.column >= end) return position;
+        if (position.line == first.line) position.column = position.column - first.column + now.column;
+        position.line = position.line - first.line + now.line;
+        return position;
+    }
+
+    // the form at `code`, which starts at `position`: found in `cache`, or else parsed
+    // (and folded) into `parser`; an uncached form with functions is retained by `evaluator`.
+    static FormCache::Form* __parse(std::string_view code, SourcePosition position, const RunOptions& options,
+                                    FormCache* cache, Evaluator& evaluator, std::optional<Parser>& parser,
+                                    std::ostream& out) {
+        std::uint64_t key = cache ? FormCache::hash(code) : 0;
+        FormCache::Form* cached = cache ? cache->find(code, key) : nullptr;
+        if (cached != nullptr) return cached;
+        parser.emplace(read_str(code, position));
+        if (options.print_ast) parser->print(out);
+        if (options.fold) Optimizer::optimize(*parser);
+        if (cache) cached = cache->insert(code, key, *parser);
+        if (cached) cached->position = position;
+        if (!cached && !parser->functions.empty()) evaluator.retain(*parser);
+        return cached;
+    }
+
+    static Value __run(ASTNode* form, FormCache::Form* cached, std::string_view code, SourcePosition position,
+                       const RunOptions& options, Evaluator& evaluator, VM& vm) {
+        try {
+            if (!options.use_vm) return evaluator.run(form);
+            if (cached) {
+                // resolved and compiled at the first run; the chunk outlives it like the AST
+                if (cached->chunk == nullptr) {
+                    Resolver::resolve(form);
+                    cached->chunk = std::make_shared<Chunk>(Compiler::compile(form));
+                }
+                return vm.execute(*cached->chunk);
+            }
+            return vm.run(form);
+        } catch (const SyntaxError& error) {
+            if (!cached) throw;
+            throw SyntaxError(error.code(), error.message(),
+                              __relocate(error.position(), code, cached->position, position));
+        }
+    }
+
+    static void __print_result(const Value& value, std::ostream& out) {
+        if (value.is_object() && value.as_object()->type_name() != nullptr) {
+            value.as_object()->print(out);
+            out << " (" << value.as_object()->type_name() << ")\n";
+            return;
+        }
+        Literal result = value.literal();
+
+        std::visit([&out](const auto& val) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(val)>, std::nullptr_t>) {
+                out << "nullptr\n";
+            } else {
+                out << val << " (" << typeid(val).name() << ")\n";
+            }
+        }, result);
+    }
+
+    bool run_file(const std::string& filename, const RunOptions& options, std::ostream& out) {
+        std::ifstream file;
+        MappedFile mapped;
+        std::unique_ptr<Reader> reader;
+        if (options.use_mmap) {
+            if (!mapped.open(filename)) return false;
+            reader = std::make_unique<Reader>(mapped.view());
+        } else {
+            file.open(filename);
+            if (!file.is_open()) return false;
+            reader = std::make_unique<Reader>(file);
+        }
+
+        std::string_view code;
+        Evaluator evaluator;
+        VM vm(evaluator);
+        evaluator.use_jit(options.jit);
+        if (!options.image.empty()) load_image(options.image, evaluator);
+        // the VM has no shadow stack, so its samples stop at the form
+        std::unique_ptr<Profiler> profiler;
+        bool in_form = false;
+        if (!options.profile.empty()) {
+            profiler = std::make_unique<Profiler>();
+            evaluator.profile(profiler.get());
+            profiler->start();
+        }
+        // the AST dump needs every form as parsed, before folding
+        std::unique_ptr<FormCache> cache;
+        if (options.cache > 0 && !options.print_ast) cache = std::make_unique<FormCache>(options.cache);
+        try {
+            while (reader->next(code)) {
+                std::optional<Parser> parser;
+                FormCache::Form* cached = __parse(code, reader->position(), options, cache.get(), evaluator, parser, out);
+                if (options.use_mmap) mapped.discard_before(code.data());
+
+                ASTNode* form = cached ? cached->form() : ((ListNode*)parser->root)->sub_nodes[0];
+                if (profiler) profiler->begin_form(code, cached ? cached->functions : parser->functions);
+                in_form = true;
+                Value value = __run(form, cached, code, reader->position(), options, evaluator, vm);
+                in_form = false;
+                if (profiler) profiler->end_form();
+                __print_result(value, out);
+            }
+        } catch (...) {
+            if (profiler) {
+                if (in_form) profiler->end_form();
+                __write_profile(*profiler, options.profile);
+            }
+            throw;
+        }
+        if (profiler) {
+            __write_profile(*profiler, options.profile);
+            evaluator.profile(nullptr);
+        }
+        if (!options.save_image.empty()) save_image(options.save_image, evaluator);
+        return true;
+    }
+
+    void run_source(std::string_view source, Evaluator& evaluator, FormCache* cache,
+                    const RunOptions& options, std::ostream& out) {
+        Reader reader(source);
+        VM vm(evaluator);
+        std::string_view code;
+        while (reader.next(code)) {
+            std::optional<Parser> parser;
+            FormCache::Form* cached = __parse(code, reader.position(), options, cache, evaluator, parser, out);
+            ASTNode* form = cached ? cached->form() : ((ListNode*)parser->root)->sub_nodes[0];
+            __print_result(__run(form, cached, code, reader.position(), options, evaluator, vm), out);
+        }
+    }
+
+    /* batch */
+    struct ScriptResult {
+        std::string output;
+        std::string stats;
+        bool failed = false;
+        double ms = 0;
+        bool done = false;
+    };
+
+    // runs one script on a heap of its own, which is freed before it returns
+    static void __run_script(const std::string& filename, const BatchOptions& options, ScriptResult& result) {
+        auto start = std::chrono::steady_clock::now();
+        std::ostringstream out;
+        {
+            Heap local;
+            if (options.gc_threshold > 0) local.configure(options.gc_threshold, 2.0);
+            use_heap(&local);
+            try {
+                if (!run_file(filename, options.run, out)) {
+                    out << "[file error] " << filename << " is inaccessible.\n";
+                    result.failed = true;
+                }
+            } catch (const std::exception& error) {
+                out << error.what() << "\n";
+                result.failed = true;
+            }
+            if (options.gc_stats) {
+                std::ostringstream stats;
+                local.print_stats(stats);
+                result.stats = stats.str();
+            }
+            // `local` frees the objects left by the script while it is still in use
+        }
+        use_heap(nullptr);
+        result.output = out.str();
+        result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    size_t run_batch(const std::vector<std::string>& files, const BatchOptions& options,
+                     std::ostream& out, std::ostream& summary) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<ScriptResult> results(files.size());
+        std::mutex lock;
+        std::condition_variable finished;
+        std::atomic<size_t> next{0};
+
+        size_t jobs = options.jobs > 0 ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+        jobs = std::min(jobs, files.size());
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < jobs; i++) {
+            threads.emplace_back([&] {
+                for (size_t index = next++; index < files.size(); index = next++) {
+                    ScriptResult result;
+                    __run_script(files[index], options, result);
+                    {
+                        std::lock_guard<std::mutex> guard(lock);
+                        results[index] = std::move(result);
+                        results[index].done = true;
+                    }
+                    finished.notify_all();
+                }
+            });
+        }
+
+        // written in input order; a result is dropped once it is written
+        size_t failed = 0;
+        double total = 0;
+        for (size_t index = 0; index < files.size(); index++) {
+            ScriptResult result;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                finished.wait(guard, [&] { return results[index].done; });
+                result = std::move(results[index]);
+            }
+            out << "{Script} " << files[index] << "\n" << result.output;
+            out.flush();
+            summary << "{Batch} " << files[index] << ": " << (result.failed ? "failed" : "ok")
+                    << ", " << result.ms << " ms\n" << result.stats;
+            if (result.failed) failed++;
+            total += result.ms;
+        }
+        for (std::thread& thread : threads) thread.join();
+
+        double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        summary << "{Batch} scripts: " << files.size() << ", failed: " << failed << ", threads: " << jobs
+                << ", time: " << total << " ms total / " << wall << " ms wall\n";
+        return failed;
+    }
+
+    bool read_manifest(const std::string& filename, std::vector<std::string>& files) {
+        std::ifstream manifest(filename);
+        if (!manifest.is_open()) return false;
+        std::string line;
+        while (std::getline(manifest, line)) {
+            size_t begin = line.find_first_not_of(" \t\r");
+            if (begin == std::string::npos || line[begin] == '#') continue;
+            size_t end = line.find_last_not_of(" \t\r");
+            files.push_back(line.substr(begin, end - begin + 1));
+        }
+        return true;
+    }
+
+} // namespace lisp
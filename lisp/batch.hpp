@@ -0,0 +1,59 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lisp {
+
+    struct RunOptions {
+        bool use_mmap = false;
+        bool use_vm = false;
+        bool fold = true;
+        bool jit = false;           // tree walker only; see jit.hpp
+        bool print_ast = false;     // the AST of each form as parsed; such a run parses every form
+        size_t cache = 256;         // forms kept by the parse cache; 0 parses every form. see cache.hpp
+        std::string image;          // image loaded before the first form; see image.hpp
+        std::string save_image;     // image of the globals written after the last form
+        std::string profile;        // folded stacks written after the last form; see profiler.hpp
+    };
+
+    // runs every form of a script with a new Evaluator on the heap of the calling
+    // thread; the parsed forms and results go to `out`. false if the file is
+    // inaccessible. an error of a form is thrown, and the rest of the script is skipped.
+    // with a profile the flat profile goes to std::cerr, also when a form fails.
+    bool run_file(const std::string& filename, const RunOptions& options, std::ostream& out);
+
+    class Evaluator;
+    class FormCache;
+
+    // runs every form of `source` with `evaluator`, printing the results to `out` like
+    // run_file; forms seen before come from `cache` unless it is nullptr. the image and
+    // profile options are not used. an error of a form is thrown.
+    void run_source(std::string_view source, Evaluator& evaluator, FormCache* cache,
+                    const RunOptions& options, std::ostream& out);
+
+    struct BatchOptions {
+        RunOptions run;
+        size_t jobs = 0;            // threads running scripts; 0 is the number of hardware threads
+        size_t gc_threshold = 0;    // min_threshold of each heap; 0 keeps the default
+        bool gc_stats = false;
+    };
+
+    // runs the scripts on a fixed number of threads, each script with its own Heap and
+    // Evaluator, so that nothing but symbol names is shared between them. the output of
+    // each script goes to `out` in input order as soon as the earlier ones are written,
+    // and its status and wall time to `summary`. returns the number of failed scripts.
+    size_t run_batch(const std::vector<std::string>& files, const BatchOptions& options,
+                     std::ostream& out, std::ostream& summary);
+
+    // adds the paths of a manifest, one per line, to `files`; blank lines and lines
+    // starting with # are skipped. false if the manifest is inaccessible.
+    bool read_manifest(const std::string& filename, std::vector<std::string>& files);
+
+} // namespace lisp
+
+#endif
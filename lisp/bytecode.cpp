@@ -0,0 +1,182 @@
+#include "bytecode.hpp"
+
+#include <iostream>
+
+namespace lisp {
+
+    /* Chunk */
+    void Chunk::print() const {
+        static const char* names[] = {
+            "Const", "LoadLocal", "StoreLocal", "LoadGlobal", "DefGlobal",
+            "Add", "Sub", "Mul", "Div", "Eq", "Less",
+            "Jump", "JumpIfFalse", "Closure", "Call", "TailCall", "Fail", "Return"
+        };
+        std::cout << "{Chunk} slots: " << this->slot_count << "\n";
+        for (const Instruction& ins : this->code)
+            std::cout << "\t" << names[(int)ins.op] << " " << ins.operand << "\n";
+    }
+
+    /* Compiler */
+    void Compiler::emit(OpCode op, std::int32_t operand) {
+        this->chunk.code.push_back({op, operand});
+        this->chunk.positions.push_back(this->position);
+    }
+
+    void Compiler::fail(ErrorCode code, const char* message) {
+        this->chunk.errors.push_back({code, message, this->position});
+        this->emit(OpCode::Fail, (std::int32_t)this->chunk.errors.size() - 1);
+    }
+
+    void Compiler::constant(Value value) {
+        this->chunk.constants.push_back(std::move(value));
+        this->emit(OpCode::Const, (std::int32_t)this->chunk.constants.size() - 1);
+    }
+
+    void Compiler::load_local(int depth, int slot) {
+        this->emit(OpCode::LoadLocal, this->frames[this->frames.size() - 1 - depth] + slot);
+    }
+
+    void Compiler::compile_node(ASTNode* node, bool tail) {
+        this->position = node->position;
+        switch (node->kind) {
+        case NodeKind::Literal:
+            return this->constant(((LiteralNode*)node)->value);
+        case NodeKind::Symbol: {
+            SymbolNode* symbol = (SymbolNode*)node;
+            if (symbol->depth >= 0) return this->load_local(symbol->depth, symbol->slot);
+            this->chunk.symbols.push_back(symbol);
+            return this->emit(OpCode::LoadGlobal, (std::int32_t)this->chunk.symbols.size() - 1);
+        }
+        case NodeKind::List:
+            return this->compile_list((ListNode*)node, tail);
+        case NodeKind::Function: {
+            FunctionNode* function = (FunctionNode*)node;
+            for (auto& capture : function->captures)
+                this->load_local(capture.first, capture.second);
+            this->chunk.functions.push_back(function);
+            return this->emit(OpCode::Closure, (std::int32_t)this->chunk.functions.size() - 1);
+        }
+        }
+    }
+
+    void Compiler::compile_list(ListNode* node, bool tail) {
+        std::vector<ASTNode*>& sub_nodes = node->sub_nodes;
+        if (sub_nodes.size() == 0)
+            return this->fail(ErrorCode::List, "[list error] List is empty.");
+        if (sub_nodes[0]->kind == NodeKind::Literal)
+            return this->fail(ErrorCode::List, "[list error] First symbol of a list is not a function.");
+
+        SymbolId oper = sub_nodes[0]->kind == NodeKind::Symbol ? ((SymbolNode*)sub_nodes[0])->symbol_id : SYM_BUILTIN_COUNT;
+        switch (oper) {
+        case SYM_DEF:
+            if (sub_nodes.size() - 1 != 2)
+                return this->fail(ErrorCode::Operator, "[operator error] Number of operand is not two.");
+            if (sub_nodes[1]->kind != NodeKind::Symbol)
+                return this->fail(ErrorCode::Operator, "[operator error] Token type of operand is not Symbol.");
+            this->compile_node(sub_nodes[2], false);
+            this->position = node->position;
+            this->emit(OpCode::DefGlobal, ((SymbolNode*)sub_nodes[1])->symbol_id);
+            return;
+        case SYM_LET:
+            if (sub_nodes.size() - 1 != 2)
+                return this->fail(ErrorCode::Operator, "[operator error] Number of operand is not two.");
+            if (sub_nodes[1]->kind != NodeKind::List)
+                return this->fail(ErrorCode::Operator, "[operator error] Token type of operand is not List.");
+            return this->compile_let((ListNode*)sub_nodes[1], sub_nodes[2], tail);
+        case SYM_IF: {
+            if (sub_nodes.size() - 1 != 3)
+                return this->fail(ErrorCode::Operator, "[operator error] Number of operand is not three.");
+            this->compile_node(sub_nodes[1], false);
+            size_t to_else = this->chunk.code.size();
+            this->emit(OpCode::JumpIfFalse);
+            this->compile_node(sub_nodes[2], tail);
+            size_t to_end = this->chunk.code.size();
+            this->emit(OpCode::Jump);
+            this->chunk.code[to_else].operand = (std::int32_t)this->chunk.code.size();
+            this->compile_node(sub_nodes[3], tail);
+            this->chunk.code[to_end].operand = (std::int32_t)this->chunk.code.size();
+            return;
+        }
+        case SYM_FN:
+            if (sub_nodes.size() - 1 != 2)
+                return this->fail(ErrorCode::Operator, "[operator error] Number of operand is not two.");
+            if (sub_nodes[1]->kind != NodeKind::List)
+                return this->fail(ErrorCode::Operator, "[operator error] Token type of operand is not List.");
+            return this->fail(ErrorCode::Operator, "[operator error] Parameter of fn* is not symbol token.");
+        case SYM_EQ:
+        case SYM_LT:
+            if (sub_nodes.size() - 1 != 2)
+                return this->fail(ErrorCode::Operator, "[operator error] Number of operand is not two.");
+            this->compile_node(sub_nodes[1], false);
+            this->compile_node(sub_nodes[2], false);
+            this->position = node->position;
+            this->emit(oper == SYM_EQ ? OpCode::Eq : OpCode::Less);
+            return;
+        case SYM_ADD:
+        case SYM_SUB:
+        case SYM_MUL:
+        case SYM_DIV: {
+            if (sub_nodes.size() == 1 && (oper == SYM_SUB || oper == SYM_DIV))
+                return this->fail(ErrorCode::Operator, "[operator error] Number of operand is not one or more.");
+            for (size_t i = 1; i < sub_nodes.size(); i++)
+                this->compile_node(sub_nodes[i], false);
+            this->position = node->position;
+            static const OpCode ops[] = { OpCode::Add, OpCode::Sub, OpCode::Mul, OpCode::Div };
+            this->emit(ops[oper - SYM_ADD], (std::int32_t)sub_nodes.size() - 1);
+            return;
+        }
+        }
+
+        for (ASTNode* sub_node : sub_nodes)
+            this->compile_node(sub_node, false);
+        this->position = node->position;
+        this->emit(tail ? OpCode::TailCall : OpCode::Call, (std::int32_t)sub_nodes.size() - 1);
+    }
+
+    void Compiler::compile_let(ListNode* parameters, ASTNode* expression, bool tail) {
+        if (parameters->sub_nodes.size() % 2 == 1)
+            return this->fail(ErrorCode::Operator, "[operator error] First list of let* does not have even size.");
+        // errors of the let* list are reported at it, as by the tree walker
+        SourcePosition position = this->position;
+        // slots of finished frames are reused by their siblings
+        int base = this->top;
+        this->top += (int)parameters->sub_nodes.size() / 2;
+        if (this->top > this->chunk.slot_count) this->chunk.slot_count = this->top;
+        this->frames.push_back(base);
+        bool complete = true;
+        for (size_t i = 0; i < parameters->sub_nodes.size(); i += 2) {
+            if (parameters->sub_nodes[i]->kind != NodeKind::Symbol) {
+                this->position = position;
+                this->fail(ErrorCode::Operator, "[operator error] Odd-th value in list of let* is not symbol token.");
+                complete = false;
+                break;
+            }
+            this->compile_node(parameters->sub_nodes[i + 1], false);
+            this->emit(OpCode::StoreLocal, base + (int)i / 2);
+        }
+        if (complete) this->compile_node(expression, tail);
+        this->frames.pop_back();
+        this->top = base;
+    }
+
+    Chunk Compiler::compile(ASTNode* root) {
+        Compiler compiler;
+        compiler.compile_node(root, true);
+        // errors without a position are reported at the form (see VM::execute)
+        compiler.position = root->position;
+        compiler.emit(OpCode::Return);
+        return std::move(compiler.chunk);
+    }
+
+    Chunk Compiler::compile(FunctionNode* function) {
+        Compiler compiler;
+        // parameters, captures and the closure itself
+        compiler.top = (int)(function->parameters.size() + function->captures.size() + 1);
+        compiler.chunk.slot_count = compiler.top;
+        compiler.frames.push_back(0);
+        compiler.compile_node(function->body, true);
+        compiler.emit(OpCode::Return);
+        return std::move(compiler.chunk);
+    }
+
+} // namespace lisp
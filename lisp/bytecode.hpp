@@ -0,0 +1,75 @@
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+#include "astnode.hpp"
+#include "symbol.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace lisp {
+
+    enum class OpCode : std::uint8_t {
+        Const,          // push constants[operand]
+        LoadLocal,      // push slots[operand]
+        StoreLocal,     // pop into slots[operand]
+        LoadGlobal,     // push global value of symbols[operand]
+        DefGlobal,      // define symbol `operand` as top of stack (kept on stack)
+        Add, Sub, Mul, Div,     // replace `operand` values on top of stack with their result
+        Eq, Less,
+        Jump,           // continue at code[operand]
+        JumpIfFalse,    // pop; continue at code[operand] if it is false or null
+        Closure,        // pop captures of functions[operand], push a closure of it
+        Call,           // call closure below `operand` arguments
+        TailCall,       // same as Call, but replaces the frame of the caller
+        Fail,           // fail with errors[operand]
+        Return
+    };
+
+    struct Instruction {
+        OpCode op;
+        std::int32_t operand;
+    };
+
+    // code of one top-level form or one function body; slots of a function
+    // start with its parameters, its captures and the closure itself.
+    class Chunk {
+    public:
+        std::vector<Instruction> code;
+        // the position of the node of each instruction, only read when it fails
+        std::vector<SourcePosition> positions;
+        std::vector<Value> constants;
+        std::vector<Error> errors;
+        std::vector<FunctionNode*> functions;
+        // global references, whose caches the VM shares with the Evaluator
+        std::vector<SymbolNode*> symbols;
+        int slot_count = 0;
+        void print() const;
+    };
+
+    // compiles one resolved form (see Resolver); structural errors become Fail
+    // instructions at the point where the tree walker would throw them, so both
+    // engines fail alike.
+    class Compiler {
+    private:
+        Chunk chunk;
+        // first slot of each let* frame, innermost last
+        std::vector<int> frames;
+        int top = 0;
+        SourcePosition position;        // of the node being compiled
+
+        void emit(OpCode op, std::int32_t operand = 0);
+        void fail(ErrorCode code, const char* message);
+        void constant(Value value);
+        void load_local(int depth, int slot);
+        void compile_node(ASTNode* node, bool tail);
+        void compile_list(ListNode* node, bool tail);
+        void compile_let(ListNode* parameters, ASTNode* expression, bool tail);
+    public:
+        static Chunk compile(ASTNode* root);
+        static Chunk compile(FunctionNode* function);
+    };
+
+} // namespace lisp
+
+#endif
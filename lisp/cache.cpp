@@ -0,0 +1,100 @@
+#include "cache.hpp"
+
+#include <atomic>
+#include <cstring>
+
+namespace lisp {
+
+    static std::atomic<size_t> total_hits{0};
+    static std::atomic<size_t> total_misses{0};
+    static std::atomic<size_t> total_evictions{0};
+
+    /* FormCache */
+    FormCache::FormCache(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {
+        size_t slots = 64;
+        while (slots < this->capacity * 4) slots *= 2;
+        this->slots.resize(slots);
+        heap().add_roots(this);
+    }
+
+    FormCache::~FormCache() {
+        heap().remove_roots(this);
+        total_hits += this->hits;
+        total_misses += this->misses;
+        total_evictions += this->evictions;
+    }
+
+    // FNV-1a over 8 bytes at a time, then the tail, then a final mix
+    std::uint64_t FormCache::hash(std::string_view source) {
+        const std::uint64_t prime = 0x100000001b3ull;
+        std::uint64_t hash = 0xcbf29ce484222325ull ^ source.size();
+        size_t i = 0;
+        for (; i + 8 <= source.size(); i += 8) {
+            std::uint64_t word;
+            std::memcpy(&word, source.data() + i, 8);
+            hash = (hash ^ word) * prime;
+        }
+        for (; i < source.size(); i++)
+            hash = (hash ^ (unsigned char)source[i]) * prime;
+        hash ^= hash >> 32;
+        hash *= 0xd6e8feb86659fd93ull;
+        return hash ^ (hash >> 32);
+    }
+
+    FormCache::Form* FormCache::find(std::string_view source, std::uint64_t key) {
+        Slot& slot = this->slot(key);
+        if (!slot.cached || slot.key != key || slot.form->source != source) {
+            this->misses++;
+            return nullptr;
+        }
+        this->hits++;
+        this->forms.splice(this->forms.begin(), this->forms, slot.form);
+        return &this->forms.front();
+    }
+
+    // the form goes back to seen once; a CodeObject left unmarked is swept with the
+    // last closure of its functions
+    void FormCache::evict(Slot& slot) {
+        this->forms.erase(slot.form);
+        slot.cached = false;
+        this->evictions++;
+    }
+
+    FormCache::Form* FormCache::insert(std::string_view source, std::uint64_t key, Parser& parser) {
+        Slot& slot = this->slot(key);
+        if (slot.key != key) {
+            // a cached form keeps its slot until it is evicted
+            if (!slot.cached) slot.key = key;
+            return nullptr;
+        }
+        if (slot.cached) this->evict(slot);
+        else if (this->forms.size() >= this->capacity) this->evict(this->slot(this->forms.back().hash));
+
+        this->forms.emplace_front();
+        Form& form = this->forms.front();
+        form.source = std::string(source);
+        form.hash = key;
+        form.root = parser.root;
+        form.functions = parser.functions;
+        if (parser.functions.empty()) {
+            form.arena = std::move(parser.arena);
+        } else {
+            form.code = heap().make<CodeObject>(std::move(parser.arena));
+            for (FunctionNode* function : parser.functions)
+                function->owner = form.code;
+        }
+        slot.cached = true;
+        slot.form = this->forms.begin();
+        return &form;
+    }
+
+    void FormCache::mark_roots(Heap& heap) {
+        for (const Form& form : this->forms) heap.mark(form.code);
+    }
+
+    void FormCache::print_stats(std::ostream& out) {
+        out << "{Cache} hits: " << total_hits << ", misses: " << total_misses
+            << ", evictions: " << total_evictions << "\n";
+    }
+
+} // namespace lisp
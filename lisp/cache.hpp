@@ -0,0 +1,86 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include "arena.hpp"
+#include "astnode.hpp"
+#include "bytecode.hpp"
+#include "heap.hpp"
+#include "parser.hpp"
+#include "value.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lisp {
+
+    // bounded LRU cache of parsed and folded top-level forms, keyed by a 64-bit hash of
+    // their source text. a hit is checked against the kept text, so a collision only
+    // costs a miss. the hashes index a direct-mapped table, at least 4 times the capacity:
+    // a form only leaves its hash there at its first sighting and is kept from the second
+    // one on, so that a script of distinct forms pays for the hash alone.
+    //
+    // a cached form runs again as it is: the Resolver gives a top-level form the same
+    // addresses every time, and the JIT counters and bytecode in its nodes stay valid.
+    // the ASTs are marked as roots of the Heap of the thread which made the cache, so it
+    // is used on that thread only, like an Evaluator.
+    class FormCache : public GcRoots {
+    public:
+        struct Form {
+            std::string source;
+            std::uint64_t hash;
+            SourcePosition position;                // where the form was parsed, which its nodes count from
+            // the AST; a form with fn* is a CodeObject, since its closures may outlive the cache
+            std::unique_ptr<Arena> arena;
+            CodeObject* code = nullptr;
+            ASTNode* root;                          // root of the Parser; the form is its only child
+            std::vector<FunctionNode*> functions;
+            std::shared_ptr<Chunk> chunk;           // bytecode of the form, compiled when a VM first runs it
+            ASTNode* form() const { return ((ListNode*)this->root)->sub_nodes[0]; }
+        };
+
+    private:
+        size_t capacity;
+        std::list<Form> forms;                      // the most recently used first
+        struct Slot {
+            std::uint64_t key = 0;
+            bool cached = false;                    // false: the form was only seen
+            std::list<Form>::iterator form;
+        };
+        std::vector<Slot> slots;                    // by the low bits of the hash
+        // added to the totals when the cache goes
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+
+        Slot& slot(std::uint64_t key) { return this->slots[key & (this->slots.size() - 1)]; }
+        void evict(Slot& slot);
+    public:
+        explicit FormCache(size_t capacity);
+        ~FormCache();
+        FormCache(const FormCache&) = delete;
+        FormCache& operator=(const FormCache&) = delete;
+
+        static std::uint64_t hash(std::string_view source);
+
+        // the form parsed from `source`, whose hash is `key`, or nullptr
+        Form* find(std::string_view source, std::uint64_t key);
+        // takes the AST of `parser`, which was parsed (and folded) from `source`; the least
+        // recently used form goes when the cache is full. nullptr, leaving `parser` as it
+        // is, when the form was not seen before.
+        Form* insert(std::string_view source, std::uint64_t key, Parser& parser);
+        size_t size() const { return this->forms.size(); }
+        void mark_roots(Heap& heap) override;
+
+        // hits, misses and evictions of every cache destroyed so far
+        static void print_stats(std::ostream& out);
+    };
+
+} // namespace lisp
+
+#endif
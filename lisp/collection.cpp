@@ -0,0 +1,578 @@
+#include "collection.hpp"
+
+#include "heap.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace lisp {
+
+    static const int BITS = 5;
+    static const size_t WIDTH = 1 << BITS;
+    static const size_t MASK = WIDTH - 1;
+
+    static std::uint32_t mix(std::uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return (std::uint32_t)x;
+    }
+
+    std::uint32_t hash_value(const Value& value) {
+        switch (value.type()) {
+        case ValueType::Int: return mix((std::uint64_t)(std::uint32_t)value.as_int() << 3 | 1);
+        case ValueType::Char: return mix((std::uint64_t)(unsigned char)value.as_char() << 3 | 2);
+        case ValueType::Bool: return mix((std::uint64_t)value.as_bool() << 3 | 3);
+        case ValueType::Null: return mix(4);
+        case ValueType::Object: break;
+        }
+        if (value.is(ObjectKind::String)) return mix(std::hash<std::string>()(value.as_string()));
+        return mix((std::uint64_t)(std::uintptr_t)value.as_object());
+    }
+
+    bool same_value(const Value& a, const Value& b) {
+        if (a.type() != b.type()) return false;
+        switch (a.type()) {
+        case ValueType::Int: return a.as_int() == b.as_int();
+        case ValueType::Char: return a.as_char() == b.as_char();
+        case ValueType::Bool: return a.as_bool() == b.as_bool();
+        case ValueType::Null: return true;
+        case ValueType::Object: break;
+        }
+        if (a.is(ObjectKind::String) && b.is(ObjectKind::String)) return a.as_string() == b.as_string();
+        return a.as_object() == b.as_object();
+    }
+
+    /* ConsObject */
+    ConsObject::ConsObject(Value head, Value tail) : Object(ObjectKind::Cons), head(head), tail(tail) {
+        this->length = tail.is(ObjectKind::Cons) ? ((ConsObject*)tail.as_object())->length + 1 : 1;
+    }
+
+    void ConsObject::trace(Heap& heap) const {
+        heap.mark(this->head);
+        heap.mark(this->tail);
+    }
+
+    size_t ConsObject::footprint() const {
+        return sizeof(ConsObject);
+    }
+
+    const char* ConsObject::type_name() const {
+        return "list";
+    }
+
+    void ConsObject::print(std::ostream& out) const {
+        out << "(";
+        for (const ConsObject* cell = this; cell != nullptr;) {
+            print_value(out, cell->head);
+            cell = cell->tail.is(ObjectKind::Cons) ? (const ConsObject*)cell->tail.as_object() : nullptr;
+            if (cell != nullptr) out << " ";
+        }
+        out << ")";
+    }
+
+    /* PersistentVectorObject */
+    PersistentVectorObject::PersistentVectorObject(std::shared_ptr<const VectorNode> root, size_t count, int shift, size_t bytes)
+        : Object(ObjectKind::PersistentVector), root(std::move(root)), count(count), shift(shift), bytes(bytes) {}
+
+    const Value& PersistentVectorObject::get(size_t index) const {
+        const VectorNode* node = this->root.get();
+        for (int shift = this->shift; shift > 0; shift -= BITS)
+            node = node->children[(index >> shift) & MASK].get();
+        return node->values[index & MASK];
+    }
+
+    static size_t node_bytes(const VectorNode& node);
+    static size_t node_bytes(const MapNode& node);
+
+    static void mark_node(Heap& heap, const VectorNode* node, size_t epoch) {
+        if (node == nullptr || node->epoch == epoch) return;
+        node->epoch = epoch;
+        heap.mark_shared(node_bytes(*node));
+        for (const Value& value : node->values) heap.mark(value);
+        for (const auto& child : node->children) mark_node(heap, child.get(), epoch);
+    }
+
+    void PersistentVectorObject::trace(Heap& heap) const {
+        mark_node(heap, this->root.get(), heap.epoch());
+    }
+
+    // `bytes` paces collections like any allocation; the whole trie is counted as
+    // live by mark_node()
+    size_t PersistentVectorObject::footprint() const {
+        return sizeof(PersistentVectorObject) + this->bytes;
+    }
+
+    const char* PersistentVectorObject::type_name() const {
+        return "vector";
+    }
+
+    void PersistentVectorObject::print(std::ostream& out) const {
+        out << "[";
+        for (size_t i = 0; i < this->count; i++) {
+            if (i > 0) out << " ";
+            print_value(out, this->get(i));
+        }
+        out << "]";
+    }
+
+    /* HashMapObject */
+    HashMapObject::HashMapObject(std::shared_ptr<const MapNode> root, size_t count, size_t bytes)
+        : Object(ObjectKind::HashMap), root(std::move(root)), count(count), bytes(bytes) {}
+
+    static size_t position(std::uint32_t bitmap, std::uint32_t bit) {
+        return std::bitset<32>(bitmap & (bit - 1)).count();
+    }
+
+    const Value* HashMapObject::get(const Value& key) const {
+        std::uint32_t hash = hash_value(key);
+        const MapNode* node = this->root.get();
+        for (int shift = 0; node != nullptr; shift += BITS) {
+            if (shift >= 32) {
+                for (const MapNode::Slot& slot : node->slots)
+                    if (same_value(slot.key, key)) return &slot.value;
+                return nullptr;
+            }
+            std::uint32_t bit = 1u << ((hash >> shift) & MASK);
+            if (!(node->bitmap & bit)) return nullptr;
+            const MapNode::Slot& slot = node->slots[position(node->bitmap, bit)];
+            if (slot.child == nullptr) return same_value(slot.key, key) ? &slot.value : nullptr;
+            node = slot.child.get();
+        }
+        return nullptr;
+    }
+
+    static void mark_node(Heap& heap, const MapNode* node, size_t epoch) {
+        if (node == nullptr || node->epoch == epoch) return;
+        node->epoch = epoch;
+        heap.mark_shared(node_bytes(*node));
+        for (const MapNode::Slot& slot : node->slots) {
+            heap.mark(slot.key);
+            heap.mark(slot.value);
+            mark_node(heap, slot.child.get(), epoch);
+        }
+    }
+
+    void HashMapObject::trace(Heap& heap) const {
+        mark_node(heap, this->root.get(), heap.epoch());
+    }
+
+    size_t HashMapObject::footprint() const {
+        return sizeof(HashMapObject) + this->bytes;
+    }
+
+    const char* HashMapObject::type_name() const {
+        return "map";
+    }
+
+    template <typename F>
+    static void for_each_entry(const MapNode* node, F&& f) {
+        if (node == nullptr) return;
+        for (const MapNode::Slot& slot : node->slots) {
+            if (slot.child != nullptr) for_each_entry(slot.child.get(), f);
+            else f(slot.key, slot.value);
+        }
+    }
+
+    std::vector<Value> HashMapObject::entries() const {
+        std::vector<Value> items;
+        items.reserve(this->count * 2);
+        for_each_entry(this->root.get(), [&](const Value& key, const Value& value) {
+            items.push_back(key);
+            items.push_back(value);
+        });
+        return items;
+    }
+
+    void HashMapObject::print(std::ostream& out) const {
+        bool first = true;
+        out << "{";
+        for_each_entry(this->root.get(), [&](const Value& key, const Value& value) {
+            if (!first) out << ", ";
+            first = false;
+            print_value(out, key);
+            out << " ";
+            print_value(out, value);
+        });
+        out << "}";
+    }
+
+    /* vector trie */
+    static size_t node_bytes(const VectorNode& node) {
+        return sizeof(VectorNode) + node.values.capacity() * sizeof(Value)
+             + node.children.capacity() * sizeof(std::shared_ptr<const VectorNode>);
+    }
+
+    static std::shared_ptr<VectorNode> copy_node(const VectorNode* node) {
+        auto copy = node != nullptr ? std::make_shared<VectorNode>(*node) : std::make_shared<VectorNode>();
+        copy->epoch = 0;
+        return copy;
+    }
+
+    static std::shared_ptr<const VectorNode> vector_set(const VectorNode* node, int shift, size_t index, const Value& value, size_t& bytes) {
+        auto copy = copy_node(node);
+        size_t slot = (index >> shift) & MASK;
+        if (shift == 0) copy->values[slot] = value;
+        else copy->children[slot] = vector_set(node->children[slot].get(), shift - BITS, index, value, bytes);
+        bytes += node_bytes(*copy);
+        return copy;
+    }
+
+    // `node` is nullptr when `index` starts a new subtree
+    static std::shared_ptr<const VectorNode> vector_push(const VectorNode* node, int shift, size_t index, const Value& value, size_t& bytes) {
+        auto copy = copy_node(node);
+        if (shift == 0) {
+            copy->values.push_back(value);
+        } else {
+            size_t slot = (index >> shift) & MASK;
+            if (slot < copy->children.size())
+                copy->children[slot] = vector_push(copy->children[slot].get(), shift - BITS, index, value, bytes);
+            else
+                copy->children.push_back(vector_push(nullptr, shift - BITS, index, value, bytes));
+        }
+        bytes += node_bytes(*copy);
+        return copy;
+    }
+
+    // full leaves first, then one level of parents at a time, instead of n pushes
+    Value make_vector(const Value* items, size_t count) {
+        std::vector<std::shared_ptr<const VectorNode>> level;
+        size_t bytes = 0;
+        for (size_t i = 0; i < count; i += WIDTH) {
+            auto leaf = std::make_shared<VectorNode>();
+            leaf->values.assign(items + i, items + std::min(count, i + WIDTH));
+            bytes += node_bytes(*leaf);
+            level.push_back(leaf);
+        }
+        int shift = 0;
+        while (level.size() > 1) {
+            std::vector<std::shared_ptr<const VectorNode>> parents;
+            for (size_t i = 0; i < level.size(); i += WIDTH) {
+                auto parent = std::make_shared<VectorNode>();
+                parent->children.assign(level.begin() + i, level.begin() + std::min(level.size(), i + WIDTH));
+                bytes += node_bytes(*parent);
+                parents.push_back(parent);
+            }
+            level.swap(parents);
+            shift += BITS;
+        }
+        std::shared_ptr<const VectorNode> root = level.empty() ? nullptr : level[0];
+        return Value(heap().make<PersistentVectorObject>(root, count, shift, bytes));
+    }
+
+    static Value vector_conj(const PersistentVectorObject* vector, const Value& value) {
+        std::shared_ptr<const VectorNode> root = vector->root;
+        int shift = vector->shift;
+        size_t bytes = 0;
+        if (root != nullptr && vector->count == WIDTH << shift) {
+            auto grown = std::make_shared<VectorNode>();
+            grown->children.push_back(root);
+            bytes += node_bytes(*grown);
+            root = grown;
+            shift += BITS;
+        }
+        root = vector_push(root.get(), shift, vector->count, value, bytes);
+        return Value(heap().make<PersistentVectorObject>(root, vector->count + 1, shift, bytes));
+    }
+
+    /* map trie */
+    static size_t node_bytes(const MapNode& node) {
+        return sizeof(MapNode) + node.slots.capacity() * sizeof(MapNode::Slot);
+    }
+
+    static std::shared_ptr<MapNode> copy_node(const MapNode* node) {
+        auto copy = node != nullptr ? std::make_shared<MapNode>(*node) : std::make_shared<MapNode>();
+        copy->epoch = 0;
+        return copy;
+    }
+
+    static std::shared_ptr<const MapNode> map_assoc(const MapNode* node, int shift, std::uint32_t hash,
+                                                    const Value& key, const Value& value, bool& added, size_t& bytes) {
+        auto copy = copy_node(node);
+        if (shift >= 32) {
+            auto found = std::find_if(copy->slots.begin(), copy->slots.end(),
+                                      [&](const MapNode::Slot& slot) { return same_value(slot.key, key); });
+            if (found != copy->slots.end()) {
+                found->value = value;
+            } else {
+                copy->slots.push_back({key, value, nullptr});
+                added = true;
+            }
+        } else {
+            std::uint32_t bit = 1u << ((hash >> shift) & MASK);
+            size_t pos = position(copy->bitmap, bit);
+            if (!(copy->bitmap & bit)) {
+                copy->bitmap |= bit;
+                copy->slots.insert(copy->slots.begin() + pos, {key, value, nullptr});
+                added = true;
+            } else {
+                MapNode::Slot& slot = copy->slots[pos];
+                if (slot.child != nullptr) {
+                    slot.child = map_assoc(slot.child.get(), shift + BITS, hash, key, value, added, bytes);
+                } else if (same_value(slot.key, key)) {
+                    slot.value = value;
+                } else {
+                    // two keys on one branch: push both a level down
+                    bool moved = false;
+                    auto child = map_assoc(nullptr, shift + BITS, hash_value(slot.key), slot.key, slot.value, moved, bytes);
+                    slot = {Value(), Value(), map_assoc(child.get(), shift + BITS, hash, key, value, added, bytes)};
+                }
+            }
+        }
+        bytes += node_bytes(*copy);
+        return copy;
+    }
+
+    // returns `node` itself when `key` is absent, and nullptr when no key is left
+    static std::shared_ptr<const MapNode> map_dissoc(const std::shared_ptr<const MapNode>& node, int shift, std::uint32_t hash,
+                                                     const Value& key, bool& removed, size_t& bytes) {
+        if (shift >= 32) {
+            auto found = std::find_if(node->slots.begin(), node->slots.end(),
+                                      [&](const MapNode::Slot& slot) { return same_value(slot.key, key); });
+            if (found == node->slots.end()) return node;
+            removed = true;
+            if (node->slots.size() == 1) return nullptr;
+            auto copy = copy_node(node.get());
+            copy->slots.erase(copy->slots.begin() + (found - node->slots.begin()));
+            bytes += node_bytes(*copy);
+            return copy;
+        }
+
+        std::uint32_t bit = 1u << ((hash >> shift) & MASK);
+        if (!(node->bitmap & bit)) return node;
+        size_t pos = position(node->bitmap, bit);
+        const MapNode::Slot& slot = node->slots[pos];
+        std::shared_ptr<const MapNode> child;
+        if (slot.child != nullptr) {
+            child = map_dissoc(slot.child, shift + BITS, hash, key, removed, bytes);
+            if (!removed) return node;
+        } else if (same_value(slot.key, key)) {
+            removed = true;
+        } else {
+            return node;
+        }
+        if (child == nullptr && node->slots.size() == 1) return nullptr;
+
+        auto copy = copy_node(node.get());
+        if (child == nullptr) {
+            copy->slots.erase(copy->slots.begin() + pos);
+            copy->bitmap &= ~bit;
+        } else if (child->slots.size() == 1 && child->slots[0].child == nullptr) {
+            // a single key left below moves back up, as if it had never been pushed down
+            copy->slots[pos] = child->slots[0];
+        } else {
+            copy->slots[pos].child = child;
+        }
+        bytes += node_bytes(*copy);
+        return copy;
+    }
+
+    static Value map_assoc(const HashMapObject* map, const Value& key, const Value& value) {
+        bool added = false;
+        size_t bytes = 0;
+        auto root = map_assoc(map->root.get(), 0, hash_value(key), key, value, added, bytes);
+        return Value(heap().make<HashMapObject>(root, map->count + added, bytes));
+    }
+
+    /* builtins */
+    static int __int_checking(const Value& value) {
+        if (!value.is_int())
+            throw SyntaxError(ErrorCode::Operator, "[operator error] Data type of operand is not Int.");
+        return value.as_int();
+    }
+
+    static bool __list_checking(const Value& value) {
+        if (!value.is(ObjectKind::Cons) && value.type() != ValueType::Null)
+            throw SyntaxError(ErrorCode::Collection, "[collection error] Data type of operand is not List.");
+        return value.is(ObjectKind::Cons);
+    }
+
+    static HashMapObject* __map_checking(const Value& value) {
+        if (!value.is(ObjectKind::HashMap))
+            throw SyntaxError(ErrorCode::Collection, "[collection error] Data type of operand is not Map.");
+        return (HashMapObject*)value.as_object();
+    }
+
+    static size_t __index_checking(const Value& value, size_t count) {
+        int index = __int_checking(value);
+        if (index < 0 || (size_t)index >= count)
+            throw SyntaxError(ErrorCode::Collection, "[collection error] Index is out of range.");
+        return index;
+    }
+
+    [[noreturn]] static void __not_collection() {
+        throw SyntaxError(ErrorCode::Collection, "[collection error] Data type of operand is not a collection.");
+    }
+
+    // `tail` is only reachable from the caller's C++ locals, so it is pinned while the cell is made
+    static Value __cons(const Value& head, const Value& tail) {
+        heap().pin(tail);
+        ConsObject* cell = heap().make<ConsObject>(head, tail);
+        heap().unpin(tail);
+        return Value(cell);
+    }
+
+    Value make_list(const Value* items, size_t count) {
+        Value result = Value::null();
+        for (size_t i = count; i > 0; i--) result = __cons(items[i - 1], result);
+        return result;
+    }
+
+    Value __list__(const Value* argv, size_t argc) {
+        return make_list(argv, argc);
+    }
+
+    Value __cons__(const Value* argv, size_t /*argc*/) {
+        __list_checking(argv[1]);
+        return Value(heap().make<ConsObject>(argv[0], argv[1]));
+    }
+
+    Value __first__(const Value* argv, size_t /*argc*/) {
+        if (!__list_checking(argv[0])) return Value::null();
+        return ((ConsObject*)argv[0].as_object())->head;
+    }
+
+    Value __rest__(const Value* argv, size_t /*argc*/) {
+        if (!__list_checking(argv[0])) return Value::null();
+        return ((ConsObject*)argv[0].as_object())->tail;
+    }
+
+    Value __vector__(const Value* argv, size_t argc) {
+        return make_vector(argv, argc);
+    }
+
+    Value make_map(const Value* items, size_t count) {
+        std::shared_ptr<const MapNode> root;
+        size_t entries = 0, bytes = 0;
+        for (size_t i = 0; i + 1 < count; i += 2) {
+            bool added = false;
+            root = map_assoc(root.get(), 0, hash_value(items[i]), items[i], items[i + 1], added, bytes);
+            entries += added;
+        }
+        return Value(heap().make<HashMapObject>(root, entries, bytes));
+    }
+
+    Value __hash_map__(const Value* argv, size_t argc) {
+        if (argc % 2 != 0)
+            throw SyntaxError(ErrorCode::Collection, "[collection error] Number of operand is not even.");
+        return make_map(argv, argc);
+    }
+
+    static size_t __count(const Value& value) {
+        if (value.type() == ValueType::Null) return 0;
+        if (value.is(ObjectKind::Cons)) return ((ConsObject*)value.as_object())->length;
+        if (value.is(ObjectKind::PersistentVector)) return ((PersistentVectorObject*)value.as_object())->count;
+        if (value.is(ObjectKind::HashMap)) return ((HashMapObject*)value.as_object())->count;
+        __not_collection();
+    }
+
+    Value __count__(const Value* argv, size_t /*argc*/) {
+        return Value::integer((int)__count(argv[0]));
+    }
+
+    Value __empty__(const Value* argv, size_t /*argc*/) {
+        return Value::boolean(__count(argv[0]) == 0);
+    }
+
+    // a missing key of a map gives null; a list is walked to its `i`-th element
+    Value __get__(const Value* argv, size_t /*argc*/) {
+        const Value& coll = argv[0];
+        if (coll.is(ObjectKind::HashMap)) {
+            const Value* value = ((HashMapObject*)coll.as_object())->get(argv[1]);
+            return value != nullptr ? *value : Value::null();
+        }
+        if (coll.is(ObjectKind::PersistentVector)) {
+            auto vector = (PersistentVectorObject*)coll.as_object();
+            return vector->get(__index_checking(argv[1], vector->count));
+        }
+        if (coll.is(ObjectKind::Cons) || coll.type() == ValueType::Null) {
+            size_t index = __index_checking(argv[1], __count(coll));
+            const ConsObject* cell = (const ConsObject*)coll.as_object();
+            for (; index > 0; index--) cell = (const ConsObject*)cell->tail.as_object();
+            return cell->head;
+        }
+        __not_collection();
+    }
+
+    // a vector also takes its length as index, which appends
+    Value __assoc__(const Value* argv, size_t /*argc*/) {
+        const Value& coll = argv[0];
+        if (coll.is(ObjectKind::HashMap)) return map_assoc((HashMapObject*)coll.as_object(), argv[1], argv[2]);
+        if (coll.is(ObjectKind::PersistentVector)) {
+            auto vector = (PersistentVectorObject*)coll.as_object();
+            size_t index = __index_checking(argv[1], vector->count + 1);
+            if (index == vector->count) return vector_conj(vector, argv[2]);
+            size_t bytes = 0;
+            auto root = vector_set(vector->root.get(), vector->shift, index, argv[2], bytes);
+            return Value(heap().make<PersistentVectorObject>(root, vector->count, vector->shift, bytes));
+        }
+        __not_collection();
+    }
+
+    Value __dissoc__(const Value* argv, size_t /*argc*/) {
+        HashMapObject* map = __map_checking(argv[0]);
+        if (map->root == nullptr) return argv[0];
+        bool removed = false;
+        size_t bytes = 0;
+        auto root = map_dissoc(map->root, 0, hash_value(argv[1]), argv[1], removed, bytes);
+        if (!removed) return argv[0];
+        return Value(heap().make<HashMapObject>(root, map->count - 1, bytes));
+    }
+
+    // adds where it is cheap: in front of a list, at the end of a vector
+    Value __conj__(const Value* argv, size_t /*argc*/) {
+        const Value& coll = argv[0];
+        if (coll.is(ObjectKind::PersistentVector)) return vector_conj((PersistentVectorObject*)coll.as_object(), argv[1]);
+        if (coll.is(ObjectKind::Cons) || coll.type() == ValueType::Null) return Value(heap().make<ConsObject>(argv[1], coll));
+        throw SyntaxError(ErrorCode::Collection, "[collection error] Data type of operand is not List or Vector.");
+    }
+
+    Value __contains__(const Value* argv, size_t /*argc*/) {
+        return Value::boolean(__map_checking(argv[0])->get(argv[1]) != nullptr);
+    }
+
+    // the keys and values are kept by the map in argv, so collecting them allocates nothing on the Heap
+    Value __keys__(const Value* argv, size_t /*argc*/) {
+        std::vector<Value> keys;
+        for_each_entry(__map_checking(argv[0])->root.get(), [&](const Value& key, const Value&) { keys.push_back(key); });
+        return make_list(keys.data(), keys.size());
+    }
+
+    Value __vals__(const Value* argv, size_t /*argc*/) {
+        std::vector<Value> values;
+        for_each_entry(__map_checking(argv[0])->root.get(), [&](const Value&, const Value& value) { values.push_back(value); });
+        return make_list(values.data(), values.size());
+    }
+
+    void define_collection_natives(Environment& globals) {
+        static const struct {
+            const char* name;
+            int arity;
+            NativeFunction function;
+        } natives[] = {
+            {"list", -1, __list__},
+            {"cons", 2, __cons__},
+            {"first", 1, __first__},
+            {"rest", 1, __rest__},
+            {"vector", -1, __vector__},
+            {"hash-map", -1, __hash_map__},
+            {"count", 1, __count__},
+            {"empty?", 1, __empty__},
+            {"get", 2, __get__},
+            {"assoc", 3, __assoc__},
+            {"dissoc", 2, __dissoc__},
+            {"conj", 2, __conj__},
+            {"contains?", 2, __contains__},
+            {"keys", 1, __keys__},
+            {"vals", 1, __vals__},
+        };
+        for (const auto& native : natives)
+            globals.add(intern(native.name), Value(heap().make<NativeObject>(native.name, native.arity, native.function)));
+    }
+
+} // namespace lisp
@@ -0,0 +1,99 @@
+#ifndef COLLECTION_HPP
+#define COLLECTION_HPP
+
+#include "environment.hpp"
+#include "error.hpp"
+#include "symbol.hpp"
+#include "value.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace lisp {
+
+    // persistent collections: an update makes a new object and leaves the old one as it was.
+    // vectors and maps are 32-way tries whose nodes are shared between versions, so an
+    // update copies only the O(log32 n) nodes on one path. nodes are plain C++ data kept
+    // by shared_ptr; the Heap sees only the collection objects, which mark the Values in
+    // their nodes, each shared node once per collection.
+
+    // map keys: strings are compared by their text, other objects by identity.
+    std::uint32_t hash_value(const Value& value);
+    bool same_value(const Value& a, const Value& b);
+
+    // one cell of a list; the empty list is null.
+    class ConsObject : public Object {
+    public:
+        Value head;
+        Value tail;         // null or a ConsObject
+        size_t length;
+        ConsObject(Value head, Value tail);
+        void trace(Heap& heap) const override;
+        size_t footprint() const override;
+        const char* type_name() const override;
+        void print(std::ostream& out) const override;
+    };
+
+    // leaves hold `values`, inner nodes `children`; never changed once shared.
+    struct VectorNode {
+        std::vector<Value> values;
+        std::vector<std::shared_ptr<const VectorNode>> children;
+        mutable size_t epoch = 0;
+    };
+
+    class PersistentVectorObject : public Object {
+    public:
+        std::shared_ptr<const VectorNode> root;     // nullptr when empty
+        size_t count;
+        int shift;          // bits of an index above the leaves
+        size_t bytes;       // nodes made for this version
+        PersistentVectorObject(std::shared_ptr<const VectorNode> root, size_t count, int shift, size_t bytes);
+        const Value& get(size_t index) const;
+        void trace(Heap& heap) const override;
+        size_t footprint() const override;
+        const char* type_name() const override;
+        void print(std::ostream& out) const override;
+    };
+
+    // node of a hash array mapped trie. below 32 bits of hash, `bitmap` tells which of the
+    // 32 branches are used and `slots` holds them in order; a slot is an entry, or a
+    // `child` for keys sharing these bits. past 32 bits, `slots` lists colliding keys.
+    struct MapNode {
+        struct Slot {
+            Value key;
+            Value value;
+            std::shared_ptr<const MapNode> child;
+        };
+        std::uint32_t bitmap = 0;
+        std::vector<Slot> slots;
+        mutable size_t epoch = 0;
+    };
+
+    class HashMapObject : public Object {
+    public:
+        std::shared_ptr<const MapNode> root;        // nullptr when empty
+        size_t count;
+        size_t bytes;       // nodes made for this version
+        HashMapObject(std::shared_ptr<const MapNode> root, size_t count, size_t bytes);
+        const Value* get(const Value& key) const;   // nullptr if `key` is absent
+        std::vector<Value> entries() const;         // keys and values, alternating
+        void trace(Heap& heap) const override;
+        size_t footprint() const override;
+        const char* type_name() const override;
+        void print(std::ostream& out) const override;
+    };
+
+    // new list or vector of `items`, which stay reachable from elsewhere until it is made.
+    Value make_list(const Value* items, size_t count);
+    Value make_vector(const Value* items, size_t count);
+    // new map of `count` items, keys and values alternating; a later key replaces an earlier one.
+    Value make_map(const Value* items, size_t count);
+
+    // defines the collection builtins (list, vector, hash-map, get, assoc, ...) as NativeObjects in `globals`.
+    void define_collection_natives(Environment& globals);
+
+} // namespace lisp
+
+#endif
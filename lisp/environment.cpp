@@ -1,30 +1,88 @@
 #include "environment.hpp"
 
 namespace lisp {
-    Environment::Environment(std::vector<SymbolNode> names, std::vector<ASTNode*> ASTnodes) {
-        for (int i = 0; i < names.size(); i++)
-            this->add(names[i], ASTnodes[i]);
+    // 0 is the version of no table, so an empty GlobalCache never hits
+    static std::atomic<std::uint64_t> versions{1};
+
+    Environment::Environment(std::vector<SymbolNode> names, std::vector<Value> values) : Environment() {
+        for (size_t i = 0; i < names.size(); i++)
+            this->add(names[i].symbol_id, values[i]);
     }
 
     Environment::Environment() {
-        return;
+        this->push(std::make_unique<Table>());
+    }
+
+    Environment::Environment(const Environment& other) {
+        this->push(std::make_unique<Table>(other.symbols()));
+    }
+
+    Environment::Environment(const Environment* base) : table(&const_cast<Table&>(base->symbols())) {}
+
+    void Environment::push(std::unique_ptr<Table> table) {
+        table->version = versions.fetch_add(1, std::memory_order_relaxed);
+        this->table.store(table.get(), std::memory_order_release);
+        this->tables.push_back(std::move(table));
+    }
+
+    void Environment::own() {
+        if (this->tables.empty()) this->push(std::make_unique<Table>(this->symbols()));
+    }
+
+    static void __bind(Environment::Table& table, SymbolId name, Value value) {
+        auto it = table.slots.find(name);
+        if (it != table.slots.end()) {
+            table.values[it->second] = std::move(value);
+            return;
+        }
+        table.slots.emplace(name, (std::uint32_t)table.values.size());
+        table.names.push_back(name);
+        table.values.push_back(std::move(value));
+    }
+
+    void Environment::add(SymbolId name, Value value) {
+        this->own();
+        __bind(*this->table.load(std::memory_order_relaxed), name, std::move(value));
+    }
+
+    void Environment::publish(SymbolId name, Value value) {
+        this->own();
+        auto copy = std::make_unique<Table>(this->symbols());
+        __bind(*copy, name, std::move(value));
+        this->push(std::move(copy));
+    }
+
+    void Environment::release() {
+        if (this->tables.size() <= 1) return;
+        this->tables.erase(this->tables.begin(), this->tables.end() - 1);
+    }
+
+    Value* Environment::get(SymbolId key) {
+        Table* symbols = this->table.load(std::memory_order_acquire);
+        auto it = symbols->slots.find(key);
+        if (it == symbols->slots.end()) return nullptr;
+        return &symbols->values[it->second];
     }
 
-    void Environment::add(SymbolNode name, ASTNode* node) {
-        // check
-        this->symbols.insert({name.symbol_name, node});
+    // the miss of a cached get(); an undefined name is not cached
+    Value* Environment::find(Table* table, SymbolId name, const GlobalCache& cache) {
+        auto it = table->slots.find(name);
+        if (it == table->slots.end()) return nullptr;
+        if (it->second < (1u << GlobalCache::SLOT_BITS) && table->version < (1ull << (64 - GlobalCache::SLOT_BITS)))
+            cache.key.store(table->version << GlobalCache::SLOT_BITS | it->second, std::memory_order_relaxed);
+        return &table->values[it->second];
     }
 
-    ASTNode* Environment::get(std::string key) {
-        if (this->symbols.find(key) == this->symbols.end()) return nullptr;
-        return this->symbols[key];
+    const Environment::Table& Environment::symbols() const {
+        return *this->table.load(std::memory_order_acquire);
     }
 
     void Environment::print() {
+        const Table& table = this->symbols();
         std::cout << "{Environment}\n";
-        for (auto it = this->symbols.begin(); it != this->symbols.end(); it++) {
-            std::cout << "\t\t" << it->first << " ";
-            it->second->print();
+        for (size_t i = 0; i < table.size(); i++) {
+            std::cout << "\t\t" << symbol_name(table.names[i]) << " ";
+            LiteralNode(table.values[i].literal()).print(std::cout);
         }
     }
-}
\ No newline at end of file
+}
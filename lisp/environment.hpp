@@ -2,22 +2,68 @@
 #define ENVIRONMENT_HPP
 
 #include "astnode.hpp"
+#include "symbol.hpp"
+#include "value.hpp"
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <unordered_map>
 #include <string>
 #include <vector>
 #include <iostream>
 
 namespace lisp {
+    // global bindings. tasks of a ThreadPool read them without a lock while the root
+    // evaluator may define more: publish() swaps in a copy with the new binding, and
+    // the replaced tables are kept until release(), when no task runs.
+    //
+    // a name keeps its slot in every copy of a table. each table has a version of its
+    // own, from one counter for the process, so a GlobalCache which recorded a slot
+    // for this version is right for this table only: another Environment, or the copy
+    // made by publish(), misses once and finds the name again. def! in place writes
+    // the slot, which every cached reference reads.
     class Environment {
     public:
-        std::unordered_map<std::string, ASTNode*> symbols;
-        Environment(std::vector<SymbolNode>, std::vector<ASTNode*>);
+        struct Table {
+            std::unordered_map<SymbolId, std::uint32_t> slots;
+            std::vector<SymbolId> names;        // by slot
+            std::vector<Value> values;          // by slot
+            std::uint64_t version;
+            size_t size() const { return this->values.size(); }
+        };
+    private:
+        std::atomic<Table*> table;
+        std::vector<std::unique_ptr<Table>> tables;     // the current one last
+
+        void push(std::unique_ptr<Table> table);
+        void own();
+        Value* find(Table* table, SymbolId name, const GlobalCache& cache);
+    public:
+        Environment(std::vector<SymbolNode>, std::vector<Value>);
         Environment();
-        void add(SymbolNode name, ASTNode* node);
-        ASTNode* get(std::string key);
+        Environment(const Environment& other);
+        // reads the table of `base`, which must outlive it and define nothing meanwhile,
+        // until the first add() or publish() copies it
+        explicit Environment(const Environment* base);
+        Environment& operator=(const Environment&) = delete;
+        // in place; nothing else may read at the same time
+        void add(SymbolId name, Value value);
+        // safe while other threads call get()
+        void publish(SymbolId name, Value value);
+        void release();
+        Value* get(SymbolId key);
+        // get() for one reference, through its cache
+        Value* get(SymbolId name, const GlobalCache& cache) {
+            Table* table = this->table.load(std::memory_order_acquire);
+            std::uint64_t key = cache.key.load(std::memory_order_relaxed);
+            if (key >> GlobalCache::SLOT_BITS == table->version)
+                return &table->values[key & ((1u << GlobalCache::SLOT_BITS) - 1)];
+            return this->find(table, name, cache);
+        }
+        const Table& symbols() const;
         void print();
     };
 } // namespace lisp
 
-#endif
\ No newline at end of file
+#endif
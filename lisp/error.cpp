@@ -1,12 +1,35 @@
 #include "error.hpp"
 
 namespace lisp {
-    
+
     /* SyntaxError */
-    SyntaxError::SyntaxError(char* spec) : specific_reason(spec) {}
+    SyntaxError::SyntaxError(ErrorCode code, const char* message, SourcePosition position)
+        : SyntaxError(Error{code, message, position}) {}
+
+    SyntaxError::SyntaxError(const Error& error) : error(error), text(error.message) {
+        if (error.position.line > 0)
+            this->text += " (line " + std::to_string(error.position.line) + ", column "
+                        + std::to_string(error.position.column) + ")";
+    }
 
     const char* SyntaxError::what() const noexcept {
-        return specific_reason;
+        return this->text.c_str();
+    }
+
+    static thread_local Error pending;
+
+    Error& pending_error() {
+        return pending;
+    }
+
+    void set_pending_error(ErrorCode code, const char* message, SourcePosition position) {
+        pending = Error{code, message, position};
+    }
+
+    void throw_pending_error() {
+        Error error = pending;
+        pending = Error();
+        throw SyntaxError(error);
     }
 
-} // namespace lisp
\ No newline at end of file
+} // namespace lisp
@@ -1,18 +1,56 @@
 #ifndef ERROR_HPP
 #define ERROR_HPP
 
+#include <cstdint>
 #include <exception>
+#include <string>
 
 namespace lisp {
 
+    // the kind of an error, after the `[... error]` prefix of its message
+    enum class ErrorCode : std::uint8_t {
+        None, Parentheses, Token, UndefinedSymbol, List, Operator, Parallel, Vector, Collection, Image, Profile, Server
+    };
+
+    // where a token or node starts in its file, counted from 1; line 0 is unknown
+    struct SourcePosition {
+        std::uint32_t line = 0;
+        std::uint32_t column = 0;
+    };
+
+    // an error passed along as a status: the evaluator, the VM and the parser return a
+    // failure and leave the error in pending_error(), so nothing unwinds until it
+    // reaches their public API, which throws it as a SyntaxError.
+    struct Error {
+        ErrorCode code = ErrorCode::None;
+        const char* message = nullptr;
+        SourcePosition position;
+    };
+
     class SyntaxError : public std::exception {
     private:
-        char* specific_reason;
+        Error error;
+        std::string text;       // the message, then the position if it is known
     public:
-        SyntaxError(char* spec);
+        SyntaxError(ErrorCode code, const char* message, SourcePosition position = SourcePosition());
+        explicit SyntaxError(const Error& error);
+        ErrorCode code() const { return this->error.code; }
+        const char* message() const { return this->error.message; }
+        SourcePosition position() const { return this->error.position; }
         const char* what() const noexcept override;
     };
 
+    // the error of the last failure on the calling thread
+    Error& pending_error();
+    // records the error of a failure, which replaces the one before
+    void set_pending_error(ErrorCode code, const char* message, SourcePosition position = SourcePosition());
+    // gives the pending error the position of the node it passes through, unless it has one
+    inline void locate_pending_error(SourcePosition position) {
+        Error& error = pending_error();
+        if (error.position.line == 0) error.position = position;
+    }
+    [[noreturn]] void throw_pending_error();
+
 } // namespace lisp
 
-#endif
\ No newline at end of file
+#endif
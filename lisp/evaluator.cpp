@@ -1,168 +1,429 @@
 #include "evaluator.hpp"
 
+#include "jit.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+
 namespace lisp {
 
     /*
     void FunctionNode::fix_values(ASTNode* node, Environment* env) {
-        if (node->type == "List") {
+        if (node->kind == NodeKind::List) {
             for (auto sub_node : ((ListNode*)node)->sub_nodes)
                 this->fix_values(sub_node, env);
         }
-        else if (node->type == "Symbol") {
-            if (this->parameters.find(((SymbolNode*)node)->symbol_name) == this->parameters.end())
-                if (env->symbols.find(((SymbolNode*)node)->symbol_name) != env->symbols.end()) 
-                    node = env->symbols[((SymbolNode*)node)->symbol_name];
+        else if (node->kind == NodeKind::Symbol) {
+            if (this->parameters.find(((SymbolNode*)node)->symbol_id) == this->parameters.end())
+                if (env->symbols.find(((SymbolNode*)node)->symbol_id) != env->symbols.end()) 
+                    node = env->symbols[((SymbolNode*)node)->symbol_id];
         }
     }
     */
 
-    std::vector<int> __int_checking(std::vector<Literal> argv) {
-        std::vector<int> res;
-        for (int i = 0; i < 2; i++) {
-            if (!std::holds_alternative<int>(argv[i]))
-                throw SyntaxError((char*)"[operator error] Data type of operand is not Int.");
-            res.push_back(*(std::get_if<int>(&argv[i])));
+    bool __int_checking(const Value* argv) {
+        return argv[0].is_int() && argv[1].is_int();
+    }
+
+    Value __eq__(const Value* argv) {
+        if (!__int_checking(argv)) return fail(ErrorCode::Operator, "[operator error] Data type of operand is not Int.");
+        return Value::boolean(argv[0].as_int() == argv[1].as_int());
+    }
+
+    Value __lt__(const Value* argv) {
+        if (!__int_checking(argv)) return fail(ErrorCode::Operator, "[operator error] Data type of operand is not Int.");
+        return Value::boolean(argv[0].as_int() < argv[1].as_int());
+    }
+
+    Value __global__(Evaluator* eval, SymbolNode* name, const Value* argv) {
+        if (in_parallel_task())
+            return fail(ErrorCode::Parallel, "[parallel error] def! is not allowed in a parallel task.");
+        eval->define(name->symbol_id, argv[0]);
+        return argv[0];
+    }
+
+    // errors of the tree walker are failures (see Value::failure()) which every caller
+    // passes on; each gives the error its position unless a node below already did.
+    // nodes loaded from an image have none, so `site`, where the walk began, is next.
+    static Value __fail(const ASTNode* node, const ASTNode* site, ErrorCode code, const char* message) {
+        set_pending_error(code, message, node->position);
+        locate_pending_error(site->position);
+        return Value::failure();
+    }
+
+    static Value __failed(const ASTNode* node, const ASTNode* site) {
+        locate_pending_error(node->position);
+        locate_pending_error(site->position);
+        return Value::failure();
+    }
+
+    // a native reports an error by throwing, since it may be called from C++ too
+    static Value __call_native(NativeObject* native, const Value* argv, size_t argc) {
+        try {
+            return native->function(argv, argc);
+        } catch (const SyntaxError& error) {
+            set_pending_error(error.code(), error.message(), error.position());
+            return Value::failure();
         }
-        return res;
     }
 
-    Literal __add__(std::vector<Literal> argv) {
-        std::vector<int> num = __int_checking(argv);
-        return num[0] + num[1];
+    // false and null are false, every other value is true
+    bool __truthy__(const Value& value) {
+        if (value.type() == ValueType::Bool) return value.as_bool();
+        return value.type() != ValueType::Null;
     }
 
-    Literal __sub__(std::vector<Literal> argv) {
-        std::vector<int> num = __int_checking(argv);
-        return num[0] - num[1];
+    thread_local Evaluator* Evaluator::active = nullptr;
+
+    Evaluator::Evaluator(Environment globals) : environment(&this->globals), globals(globals) {
+        heap().add_roots(this);
+        define_vector_natives(this->globals);
+        define_collection_natives(this->globals);
+        define_parallel_natives(this->globals);
+        if (active == nullptr) active = this;
+    }
+    Evaluator::Evaluator() : environment(&this->globals) {
+        heap().add_roots(this);
+        define_vector_natives(this->globals);
+        define_collection_natives(this->globals);
+        define_parallel_natives(this->globals);
+        if (active == nullptr) active = this;
+    }
+    Evaluator::Evaluator(Evaluator* parent) : parent(parent), environment(parent->environment) {
+        heap().add_roots(this);
+    }
+    Evaluator::Evaluator(const Environment* base) : environment(&this->globals), globals(base) {
+        heap().add_roots(this);
     }
 
-    Literal __mul__(std::vector<Literal> argv) {
-        std::vector<int> num = __int_checking(argv);
-        return num[0] * num[1];
+    std::unique_ptr<Evaluator> Evaluator::session(Evaluator& base) {
+        std::unique_ptr<Evaluator> session(new Evaluator(&base.globals));
+        session->host = &base;
+        return session;
+    }
+    Evaluator::~Evaluator() {
+        // tasks of a session read its globals, so none may outlive it
+        if (this->host != nullptr && this->host->workers != nullptr) this->host->workers->finish(*this);
+        // workers go first; they read the globals of this evaluator
+        this->workers.reset();
+        heap().remove_roots(this);
+        if (active == this) active = nullptr;
     }
 
-    Literal __intdiv__(std::vector<Literal> argv) {
-        std::vector<int> num = __int_checking(argv);
-        return num[0] / num[1];
+    // running tasks read the globals without a lock, so while there are any a new
+    // binding goes to a copy of the globals; a task itself may not define one
+    void Evaluator::define(SymbolId name, Value value) {
+        if (in_parallel_task())
+            throw SyntaxError(ErrorCode::Parallel, "[parallel error] def! is not allowed in a parallel task.");
+        if (this->profiler != nullptr && value.is_closure())
+            this->profiler->name_function(value.as_closure()->function, name);
+        ThreadPool* workers = this->host != nullptr ? this->host->workers.get() : this->workers.get();
+        if (workers != nullptr && workers->busy()) {
+            this->environment->publish(name, std::move(value));
+        } else {
+            this->environment->release();
+            this->environment->add(name, std::move(value));
+        }
     }
 
-    Literal __global__(Evaluator* eval, SymbolNode* name, std::vector<Literal> argv) {
-        eval->env_stack[0].add(name->symbol_name, new LiteralNode(argv[0]));
-        return argv[0];
+    void Evaluator::retain(Parser& parser) {
+        this->code = heap().make<CodeObject>(std::move(parser.arena));
+        for (FunctionNode* function : parser.functions)
+            function->owner = this->code;
     }
 
-    Literal __local__(Evaluator* eval, ListNode* parameters, ASTNode* expression) {
-        eval->env_stack.push_back(Environment());
-        if (parameters->sub_nodes.size() % 2 == 1)
-            throw SyntaxError((char*)"[operator error] First list of let* does not have even size.");
-        for (int i = 0; i < parameters->sub_nodes.size(); i += 2) {
-            if (parameters->sub_nodes[i]->type != "Symbol")
-                throw SyntaxError((char*)"[operator error] Odd-th value in list of let* is not symbol token.");
-            eval->env_stack.back().add(
-                ((SymbolNode*)parameters->sub_nodes[i])->symbol_name, 
-                new LiteralNode(eval->run(parameters->sub_nodes[i+1]))
-            );
+    void Evaluator::mark_roots(Heap& heap) {
+        if (this->parent == nullptr) {
+            heap.mark(this->code);
+            for (const Value& value : this->globals.symbols().values) heap.mark(value);
         }
-        Literal res = eval->run(expression);
-        eval->env_stack.pop_back();
-        return res;
+        for (const Value& value : this->slots) heap.mark(value);
+        for (const Value& value : this->temporaries) heap.mark(value);
+    }
+
+    void Evaluator::profile(Profiler* profiler) {
+        this->profiler = profiler;
+    }
+
+    // workers of the pool never run the JIT, so that only one thread touches the counters
+    void Evaluator::use_jit(bool enabled) {
+        this->jit_enabled = enabled && this->parent == nullptr && Jit::supported();
+    }
+
+    ThreadPool& Evaluator::pool() {
+        if (this->parent != nullptr) return this->parent->pool();
+        if (this->host != nullptr) return this->host->pool();
+        if (this->workers == nullptr) this->workers = std::make_unique<ThreadPool>(*this, parallelism());
+        return *this->workers;
+    }
+
+    Evaluator* Evaluator::current() {
+        return active;
     }
 
-    Evaluator::Evaluator(Environment globals) {
-        this->env_stack.push_back(globals);
+    void Evaluator::set_current(Evaluator* evaluator) {
+        active = evaluator;
     }
-    Evaluator::Evaluator() {
-        this->env_stack.push_back(Environment());
+
+    Value& Evaluator::local(int depth, int slot) {
+        return this->slots[this->frames[this->frames.size() - 1 - depth] + slot];
+    }
+
+    Value Evaluator::run(ASTNode* root) {
+        // frames left by a form which threw are dropped here
+        this->slots.clear();
+        this->frames.clear();
+        this->temporaries.clear();
+        active = this;
+        Resolver::resolve(root);
+        Value value = this->eval(root);
+        if (value.is_failure()) throw_pending_error();
+        return value;
     }
 
-    ASTNode* Evaluator::find(std::string name) {
-        for (int i = (int)(this->env_stack.size()) - 1; i >= 0; i--) {
-            ASTNode* res = this->env_stack[i].get(name);
-            if (res) return res;
+    struct Evaluator::FrameMark {
+        Evaluator* eval;
+        size_t frames;
+        size_t slots;
+        size_t temporaries;
+        Profiler* profiler;
+        size_t labels;      // depth of the profiler's stack
+        size_t floor;       // labels under the operator being evaluated; a tail call adds its function
+        void drop() {
+            eval->frames.resize(frames);
+            eval->slots.resize(slots);
+        }
+        ~FrameMark() {
+            drop();
+            eval->temporaries.resize(temporaries);
+            if (profiler != nullptr) profiler->reset(labels);
+        }
+    };
+
+    // checks the closure and arguments in temporaries[argv...] and pushes the frame
+    // of the call; returns the body to run in it, or nullptr with the error pending.
+    ASTNode* Evaluator::enter(size_t argv) {
+        std::vector<Value>& temporaries = this->temporaries;
+        Value callee = temporaries[argv];
+        if (!callee.is_closure()) {
+            set_pending_error(ErrorCode::List, "[list error] First symbol of a list is not a function.");
+            return nullptr;
         }
-        throw SyntaxError((char*)"[undefined symbol error] Included symbol have not been defined.");
+        ClosureObject* closure = callee.as_closure();
+        FunctionNode* function = closure->function;
+        if (function->parameters.size() != temporaries.size() - argv - 1) {
+            set_pending_error(ErrorCode::List, "[list error] Mismatch between the number of parameters and the number of input values.");
+            return nullptr;
+        }
+
+        size_t base = this->slots.size();
+        this->frames.push_back(base);
+        for (size_t i = argv + 1; i < temporaries.size(); i++)
+            this->slots.push_back(temporaries[i]);
+        for (const Value& value : closure->captured)
+            this->slots.push_back(value);
+        // keeps the code of the function alive while it runs
+        this->slots.push_back(callee);
+        return function->body;
     }
 
-    Literal Evaluator::run(ASTNode* node) {
-        if (node->type == "Literal") return ((LiteralNode*)node)->literal;
-        else if (node->type == "Function") {
-            return nullptr; // implemented later
+    Value Evaluator::apply(Value callee, const Value* argv, size_t argc) {
+        FrameMark mark{this, this->frames.size(), this->slots.size(), this->temporaries.size(),
+                       this->profiler, this->profiler != nullptr ? this->profiler->mark() : 0, 0};
+        // `argv` may point into `temporaries`, which the pushes below may move
+        std::vector<Value> arguments(argv, argv + argc);
+        size_t base = this->temporaries.size();
+        this->temporaries.push_back(callee);
+        this->temporaries.insert(this->temporaries.end(), arguments.begin(), arguments.end());
+        if (callee.is_native()) {
+            NativeObject* native = callee.as_native();
+            if (native->arity >= 0 && (size_t)native->arity != argc)
+                throw SyntaxError(ErrorCode::List, "[list error] Mismatch between the number of parameters and the number of input values.");
+            if (this->profiler != nullptr) this->profiler->enter_native(native);
+            return native->function(this->temporaries.data() + base + 1, argc);
         }
-        else if (node->type == "Symbol") {
-            ASTNode* now = this->find(((SymbolNode*)node)->symbol_name);
-            if (now->type == "Function") {
-                return nullptr; // implemented later
-            } else {
-                assert(now->type == "Literal");
-                return ((LiteralNode*)now)->literal;
-            }
+        ASTNode* body = this->enter(base);
+        if (body == nullptr) throw_pending_error();
+        if (this->profiler != nullptr) this->profiler->enter_function(mark.labels, callee.as_closure()->function);
+        Value value = this->eval(body);
+        if (value.is_failure()) throw_pending_error();
+        return value;
+    }
+
+    // a copy of the loop without the profiler keeps its hooks off the common path
+    Value Evaluator::eval(ASTNode* node) {
+        return this->profiler != nullptr ? this->walk<true>(node) : this->walk<false>(node);
+    }
+
+    // a literal, a local or a global found through its cache needs no frame of its own;
+    // anything else is walked. such a global gets no label while profiling either, since
+    // the label would cost more than the lookup.
+    template <bool Profiled>
+    inline Value Evaluator::operand(ASTNode* node) {
+        if (node->kind == NodeKind::Literal) return ((LiteralNode*)node)->value;
+        if (node->kind == NodeKind::Symbol) {
+            SymbolNode* symbol = (SymbolNode*)node;
+            if (symbol->depth >= 0) return this->local(symbol->depth, symbol->slot);
+            if (Value* now = this->environment->get(symbol->symbol_id, symbol->global)) return *now;
         }
-        else {
-            assert(node->type == "List");
-
-            if (((ListNode*)node)->sub_nodes.size() == 0)
-                throw SyntaxError((char*)"[list error] List is empty.");
-            
-            if (((ListNode*)node)->sub_nodes[0]->type == "Literal")
-                throw SyntaxError((char*)"[list error] First symbol of a list is not a function.");
-            
-            if (((ListNode*)node)->sub_nodes[0]->type == "Symbol") {
-                SymbolNode* oper = (SymbolNode*)((ListNode*)node)->sub_nodes[0];
-                std::vector<Literal> argv;
-
-                if (oper->symbol_name == "def!") {
-                    if (((ListNode*)node)->sub_nodes.size() - 1 != 2)
-                        throw SyntaxError((char*)"[operator error] Number of operand is not two.");
-                    if (((ListNode*)node)->sub_nodes[1]->type != "Symbol")
-                        throw SyntaxError((char*)"[operator error] Token type of operand is not Symbol.");
-                    argv.push_back(this->run(((ListNode*)node)->sub_nodes[2]));
-                    return __global__(this, (SymbolNode*)(((ListNode*)node)->sub_nodes[1]), argv);
-                }
-                if (oper->symbol_name == "let*") {
-                    if (((ListNode*)node)->sub_nodes.size() - 1 != 2)
-                        throw SyntaxError((char*)"[operator error] Number of operand is not two.");
-                    if (((ListNode*)node)->sub_nodes[1]->type != "List")
-                        throw SyntaxError((char*)"[operator error] Token type of operand is not List.");
-                    return __local__(this, (ListNode*)(((ListNode*)node)->sub_nodes[1]), ((ListNode*)node)->sub_nodes[2]);
-                }
+        return this->walk<Profiled>(node);
+    }
 
-                if (oper->symbol_name == "+") {
-                    if (((ListNode*)node)->sub_nodes.size() - 1 != 2)
-                        throw SyntaxError((char*)"[operator error] Number of operand is not two.");
-                    argv.push_back(this->run(((ListNode*)node)->sub_nodes[1]));
-                    argv.push_back(this->run(((ListNode*)node)->sub_nodes[2]));
-                    return __add__(argv);
-                }
-                if (oper->symbol_name == "-") {
-                    if (((ListNode*)node)->sub_nodes.size() - 1 != 2)
-                        throw SyntaxError((char*)"[operator error] Number of operand is not two.");
-                    argv.push_back(this->run(((ListNode*)node)->sub_nodes[1]));
-                    argv.push_back(this->run(((ListNode*)node)->sub_nodes[2]));
-                    return __sub__(argv);
-                }
-                if (oper->symbol_name == "*") {
-                    if (((ListNode*)node)->sub_nodes.size() - 1 != 2)
-                        throw SyntaxError((char*)"[operator error] Number of operand is not two.");
-                    argv.push_back(this->run(((ListNode*)node)->sub_nodes[1]));
-                    argv.push_back(this->run(((ListNode*)node)->sub_nodes[2]));
-                    return __mul__(argv);
+    // let* bodies, if branches and calls in tail position loop here instead of
+    // recursing; the frames they push are dropped when this call returns.
+    template <bool Profiled>
+    Value Evaluator::walk(ASTNode* node) {
+        // not nullptr when Profiled
+        Profiler* const profiler = this->profiler;
+        size_t depth = Profiled ? profiler->mark() : 0;
+        FrameMark mark{this, this->frames.size(), this->slots.size(), this->temporaries.size(),
+                       Profiled ? profiler : nullptr, depth, depth};
+        std::vector<Value>& temporaries = this->temporaries;
+        ASTNode* const site = node;
+
+        while (true) {
+            switch (node->kind) {
+            case NodeKind::Literal:
+                return ((LiteralNode*)node)->value;
+            case NodeKind::Function: {
+                FunctionNode* function = (FunctionNode*)node;
+                if constexpr (Profiled) profiler->push(Profiler::operator_label(SYM_FN));
+                ClosureObject* closure = heap().make<ClosureObject>(function);
+                for (auto& capture : function->captures)
+                    closure->captured.push_back(this->local(capture.first, capture.second));
+                return Value(closure);
+            }
+            case NodeKind::Symbol: {
+                SymbolNode* symbol = (SymbolNode*)node;
+                if (symbol->depth >= 0)
+                    return this->local(symbol->depth, symbol->slot);
+                if constexpr (Profiled) profiler->push(Profiler::LOOKUP);
+                Value* now = this->environment->get(symbol->symbol_id, symbol->global);
+                if (now == nullptr)
+                    return __fail(node, site, ErrorCode::UndefinedSymbol, "[undefined symbol error] Included symbol have not been defined.");
+                return *now;
+            }
+            case NodeKind::List:
+                break;
+            }
+
+            std::vector<ASTNode*>& sub_nodes = ((ListNode*)node)->sub_nodes;
+
+            if (sub_nodes.size() == 0)
+                return __fail(node, site, ErrorCode::List, "[list error] List is empty.");
+            if (sub_nodes[0]->kind == NodeKind::Literal)
+                return __fail(node, site, ErrorCode::List, "[list error] First symbol of a list is not a function.");
+
+            size_t argv = temporaries.size();
+            if (sub_nodes[0]->kind == NodeKind::Symbol && ((SymbolNode*)sub_nodes[0])->symbol_id < SYM_BUILTIN_COUNT) {
+                SymbolId oper = ((SymbolNode*)sub_nodes[0])->symbol_id;
+                if constexpr (Profiled) profiler->enter_operator(mark.floor, oper);
+                Value compiled;
+                switch (oper) {
+                case SYM_DEF:
+                    if (sub_nodes.size() - 1 != 2)
+                        return __fail(node, site, ErrorCode::Operator, "[operator error] Number of operand is not two.");
+                    if (sub_nodes[1]->kind != NodeKind::Symbol)
+                        return __fail(node, site, ErrorCode::Operator, "[operator error] Token type of operand is not Symbol.");
+                    compiled = this->operand<Profiled>(sub_nodes[2]);
+                    if (compiled.is_failure()) return __failed(node, site);
+                    temporaries.push_back(compiled);
+                    compiled = __global__(this, (SymbolNode*)(sub_nodes[1]), &temporaries[argv]);
+                    return compiled.is_failure() ? __failed(node, site) : compiled;
+                case SYM_LET: {
+                    if (sub_nodes.size() - 1 != 2)
+                        return __fail(node, site, ErrorCode::Operator, "[operator error] Number of operand is not two.");
+                    if (sub_nodes[1]->kind != NodeKind::List)
+                        return __fail(node, site, ErrorCode::Operator, "[operator error] Token type of operand is not List.");
+                    std::vector<ASTNode*>& parameters = ((ListNode*)sub_nodes[1])->sub_nodes;
+                    if (parameters.size() % 2 == 1)
+                        return __fail(node, site, ErrorCode::Operator, "[operator error] First list of let* does not have even size.");
+                    size_t base = this->slots.size();
+                    this->slots.resize(base + parameters.size() / 2);
+                    this->frames.push_back(base);
+                    for (size_t i = 0; i < parameters.size(); i += 2) {
+                        if (parameters[i]->kind != NodeKind::Symbol)
+                            return __fail(node, site, ErrorCode::Operator, "[operator error] Odd-th value in list of let* is not symbol token.");
+                        // eval() may grow slots, so index it only after it returns
+                        Value value = this->operand<Profiled>(parameters[i + 1]);
+                        if (value.is_failure()) return __failed(node, site);
+                        this->slots[base + i / 2] = std::move(value);
+                    }
+                    if constexpr (Profiled) profiler->reset(mark.floor);
+                    node = sub_nodes[2];
+                    continue;
                 }
-                if (oper->symbol_name == "/") {
-                    if (((ListNode*)node)->sub_nodes.size() - 1 != 2)
-                        throw SyntaxError((char*)"[operator error] Number of operand is not two.");
-                    argv.push_back(this->run(((ListNode*)node)->sub_nodes[1]));
-                    argv.push_back(this->run(((ListNode*)node)->sub_nodes[2]));
-                    return __intdiv__(argv);
+                case SYM_IF:
+                    if (sub_nodes.size() - 1 != 3)
+                        return __fail(node, site, ErrorCode::Operator, "[operator error] Number of operand is not three.");
+                    compiled = this->operand<Profiled>(sub_nodes[1]);
+                    if (compiled.is_failure()) return __failed(node, site);
+                    node = __truthy__(compiled) ? sub_nodes[2] : sub_nodes[3];
+                    if constexpr (Profiled) profiler->reset(mark.floor);
+                    continue;
+                case SYM_FN:
+                    // well-formed fn* lists were made FunctionNodes by the parser
+                    if (sub_nodes.size() - 1 != 2)
+                        return __fail(node, site, ErrorCode::Operator, "[operator error] Number of operand is not two.");
+                    if (sub_nodes[1]->kind != NodeKind::List)
+                        return __fail(node, site, ErrorCode::Operator, "[operator error] Token type of operand is not List.");
+                    return __fail(node, site, ErrorCode::Operator, "[operator error] Parameter of fn* is not symbol token.");
+                case SYM_EQ:
+                case SYM_LT:
+                    if (this->jit_enabled && Jit::evaluate((ListNode*)node, this->slots.data(),
+                                                           this->frames.data() + this->frames.size(), compiled))
+                        return compiled;
+                    if (sub_nodes.size() - 1 != 2)
+                        return __fail(node, site, ErrorCode::Operator, "[operator error] Number of operand is not two.");
+                    for (size_t i = 1; i < 3; i++) {
+                        compiled = this->operand<Profiled>(sub_nodes[i]);
+                        if (compiled.is_failure()) return __failed(node, site);
+                        temporaries.push_back(compiled);
+                    }
+                    compiled = oper == SYM_EQ ? __eq__(&temporaries[argv]) : __lt__(&temporaries[argv]);
+                    return compiled.is_failure() ? __failed(node, site) : compiled;
+                default:
+                    if (this->jit_enabled && Jit::evaluate((ListNode*)node, this->slots.data(),
+                                                           this->frames.data() + this->frames.size(), compiled))
+                        return compiled;
+                    if (sub_nodes.size() == 1 && (oper == SYM_SUB || oper == SYM_DIV))
+                        return __fail(node, site, ErrorCode::Operator, "[operator error] Number of operand is not one or more.");
+                    // operands go to `temporaries`, which is reused by every call
+                    for (size_t i = 1; i < sub_nodes.size(); i++) {
+                        compiled = this->operand<Profiled>(sub_nodes[i]);
+                        if (compiled.is_failure()) return __failed(node, site);
+                        temporaries.push_back(compiled);
+                    }
+                    compiled = arithmetic(oper, temporaries.data() + argv, sub_nodes.size() - 1);
+                    return compiled.is_failure() ? __failed(node, site) : compiled;
                 }
-
-                throw SyntaxError((char*)"[list error] First symbol of a list is not a function.");
             }
 
-            // FunctionNode* func = (FunctionNode*)((ListNode*)node)->sub_nodes[0];
-            // if (func->parameters.size() != ((ListNode*)node)->sub_nodes.size() - 1)
-            //     throw SyntaxError((char*)"[list error] Mismatch between the number of parameters and the number of input values.");
-            
-            return nullptr; // implemented later
+            // function call; the callee and the arguments are evaluated before any check
+            for (ASTNode* sub_node : sub_nodes) {
+                Value value = this->operand<Profiled>(sub_node);
+                if (value.is_failure()) return __failed(node, site);
+                temporaries.push_back(value);
+            }
+            Value callee = temporaries[argv];
+            if (callee.is_native()) {
+                NativeObject* native = callee.as_native();
+                if (native->arity >= 0 && (size_t)native->arity != sub_nodes.size() - 1)
+                    return __fail(node, site, ErrorCode::List, "[list error] Mismatch between the number of parameters and the number of input values.");
+                if constexpr (Profiled) profiler->enter_native(native);
+                Value value = __call_native(native, temporaries.data() + argv + 1, sub_nodes.size() - 1);
+                return value.is_failure() ? __failed(node, site) : value;
+            }
+            // the frames of this call are not used any more, so a call in tail position
+            // reuses them and runs in constant stack space.
+            mark.drop();
+            ASTNode* call = node;
+            node = this->enter(argv);
+            if (node == nullptr) return __failed(call, site);
+            if constexpr (Profiled) {
+                profiler->enter_function(mark.labels, temporaries[argv].as_closure()->function);
+                mark.floor = mark.labels + 1;
+            }
+            temporaries.resize(mark.temporaries);
         }
     }
 } // namespace lisp
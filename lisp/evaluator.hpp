@@ -1,22 +1,80 @@
 #ifndef EVALUATOR_HPP
 #define EVALUATOR_HPP
 
+#include "arena.hpp"
+#include "arithmetic.hpp"
+#include "collection.hpp"
 #include "astnode.hpp"
 #include "environment.hpp"
 #include "error.hpp"
+#include "heap.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "vector.hpp"
 
 #include <vector>
+#include <memory>
 #include <cassert>
 
 namespace lisp {
-    class Evaluator {
+    class ThreadPool;
+    class Profiler;
+
+    class Evaluator : public GcRoots {
     private:
-        ASTNode* find(std::string name);
+        struct FrameMark;
+        // code of the last retained form; a root while that form may still run
+        CodeObject* code = nullptr;
+        // let* and fn* frames; frames[i] is the index of the first slot of the i-th frame.
+        // a fn* frame is its parameters, its captures and the closure itself.
+        std::vector<Value> slots;
+        std::vector<size_t> frames;
+        // operands and callees being evaluated; kept here so that a collection sees them
+        std::vector<Value> temporaries;
+        // a worker of a ThreadPool reads the globals of its parent and owns no pool
+        Evaluator* parent = nullptr;
+        // a session runs its tasks on the pool of the evaluator it was made from
+        Evaluator* host = nullptr;
+        // the globals of def! and references; a pool worker takes those of each task
+        Environment* environment;
+        std::unique_ptr<ThreadPool> workers;
+        Profiler* profiler = nullptr;
+        bool jit_enabled = false;
+        static thread_local Evaluator* active;
+        Value& local(int depth, int slot);
+        ASTNode* enter(size_t argv);
+        Value eval(ASTNode* node);
+        template <bool Profiled> Value walk(ASTNode* node);
+        template <bool Profiled> Value operand(ASTNode* node);
+        explicit Evaluator(const Environment* base);
+        friend class ThreadPool;
     public:
         Evaluator();
-        std::vector<Environment> env_stack;
+        ~Evaluator();
+        Evaluator(const Evaluator&) = delete;
+        Evaluator& operator=(const Evaluator&) = delete;
+        Environment globals;
         Evaluator(Environment globals);
-        Literal run(ASTNode* root);
+        explicit Evaluator(Evaluator* parent);
+        // an evaluator over the globals of `base`, natives included, which its def! do
+        // not change (see Environment(const Environment*)); `base` must outlive it.
+        // its tasks run on the pool of `base`, and it waits for them when it is destroyed
+        static std::unique_ptr<Evaluator> session(Evaluator& base);
+        Value run(ASTNode* root);
+        // calls a closure or a native from C++; may run inside eval(), e.g. from a builtin
+        Value apply(Value callee, const Value* argv, size_t argc);
+        void define(SymbolId name, Value value);
+        void retain(Parser& parser);
+        void mark_roots(Heap& heap) override;
+        // labels the forms, functions and operators this evaluator runs; nullptr stops it
+        void profile(Profiler* profiler);
+        // compiles hot arithmetic lists to machine code; see jit.hpp
+        void use_jit(bool enabled);
+        // the pool of the root evaluator (of the base of a session), started at the first call
+        ThreadPool& pool();
+        // evaluator of the calling thread: the last one which ran a form, or a pool worker
+        static Evaluator* current();
+        static void set_current(Evaluator* evaluator);
     };
 } // namespace lisp
 
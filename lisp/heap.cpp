@@ -0,0 +1,152 @@
+#include "heap.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace lisp {
+
+    /* Heap */
+    Heap::Heap(size_t min_threshold) : threshold(min_threshold), min_threshold(min_threshold) {}
+
+    Heap::~Heap() {
+        // code goes first: destroying its arena unpins literals which are still alive
+        for (int pass = 0; pass < 2; pass++) {
+            Object** link = &this->objects;
+            while (*link != nullptr) {
+                Object* object = *link;
+                if ((object->kind == ObjectKind::Code) == (pass == 0)) {
+                    *link = object->next;
+                    delete object;
+                } else {
+                    link = &object->next;
+                }
+            }
+        }
+    }
+
+    void Heap::configure(size_t min_threshold, double growth) {
+        this->min_threshold = min_threshold;
+        this->growth = growth;
+        this->threshold = std::max(min_threshold, (size_t)(this->allocated * growth));
+    }
+
+    void Heap::add_roots(GcRoots* source) {
+        std::lock_guard<std::recursive_mutex> guard(this->lock);
+        this->roots.push_back(source);
+    }
+
+    void Heap::remove_roots(GcRoots* source) {
+        std::lock_guard<std::recursive_mutex> guard(this->lock);
+        this->roots.erase(std::remove(this->roots.begin(), this->roots.end(), source), this->roots.end());
+    }
+
+    void Heap::pin(const Value& value) {
+        std::lock_guard<std::recursive_mutex> guard(this->lock);
+        if (value.is_object()) value.as_object()->pins++;
+    }
+
+    void Heap::unpin(const Value& value) {
+        std::lock_guard<std::recursive_mutex> guard(this->lock);
+        if (value.is_object()) value.as_object()->pins--;
+    }
+
+    void Heap::pause_collections() {
+        std::lock_guard<std::recursive_mutex> guard(this->lock);
+        this->paused++;
+    }
+
+    void Heap::resume_collections() {
+        std::lock_guard<std::recursive_mutex> guard(this->lock);
+        this->paused--;
+    }
+
+    void Heap::mark(const Object* object) {
+        if (object == nullptr || object->marked) return;
+        const_cast<Object*>(object)->marked = true;
+        this->gray.push_back(object);
+    }
+
+    void Heap::mark(const Value& value) {
+        if (value.is_object()) this->mark(value.as_object());
+    }
+
+    void Heap::collect() {
+        std::lock_guard<std::recursive_mutex> guard(this->lock);
+        if (this->paused == 0) this->collect_locked();
+    }
+
+    void Heap::collect_locked() {
+        auto start = std::chrono::steady_clock::now();
+
+        for (Object* object = this->objects; object != nullptr; object = object->next)
+            if (object->pins > 0) this->mark(object);
+        for (GcRoots* source : this->roots)
+            source->mark_roots(*this);
+        while (!this->gray.empty()) {
+            const Object* object = this->gray.back();
+            this->gray.pop_back();
+            object->trace(*this);
+        }
+        this->sweep();
+
+        double pause = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        this->statistics.collections++;
+        this->statistics.total_pause_ms += pause;
+        this->statistics.max_pause_ms = std::max(this->statistics.max_pause_ms, pause);
+    }
+
+    void Heap::sweep() {
+        size_t live_objects = 0, live_bytes = this->shared;
+        this->shared = 0;
+        Object** link = &this->objects;
+        while (*link != nullptr) {
+            Object* object = *link;
+            if (object->marked) {
+                object->marked = false;
+                live_objects++;
+                live_bytes += object->footprint();
+                link = &object->next;
+            } else {
+                *link = object->next;
+                this->statistics.freed_objects++;
+                this->statistics.freed_bytes += object->footprint();
+                delete object;
+            }
+        }
+        this->statistics.live_objects = live_objects;
+        this->statistics.live_bytes = live_bytes;
+        this->allocated = live_bytes;
+        this->threshold = std::max(this->min_threshold, (size_t)(live_bytes * this->growth));
+    }
+
+    size_t Heap::bytes_allocated() const {
+        return this->allocated;
+    }
+
+    GcStats Heap::stats() const {
+        std::lock_guard<std::recursive_mutex> guard(this->lock);
+        return this->statistics;
+    }
+
+    void Heap::print_stats(std::ostream& out) const {
+        GcStats s = this->stats();
+        out << "{GcStats} collections: " << s.collections
+                  << ", freed: " << s.freed_objects << " objects / " << s.freed_bytes << " bytes"
+                  << ", live: " << s.live_objects << " objects / " << s.live_bytes << " bytes"
+                  << ", pause: " << s.total_pause_ms << " ms total / " << s.max_pause_ms << " ms max\n";
+    }
+
+    static thread_local Heap* selected = nullptr;
+
+    Heap& heap() {
+        if (selected != nullptr) return *selected;
+        static Heap instance;
+        return instance;
+    }
+
+    void use_heap(Heap* heap) {
+        selected = heap;
+    }
+
+} // namespace lisp
@@ -0,0 +1,109 @@
+#ifndef HEAP_HPP
+#define HEAP_HPP
+
+#include "value.hpp"
+
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace lisp {
+
+    struct GcStats {
+        size_t collections = 0;
+        size_t freed_objects = 0;
+        size_t freed_bytes = 0;
+        size_t live_objects = 0;
+        size_t live_bytes = 0;
+        size_t allocated_objects = 0;   // every object made so far
+        size_t allocated_bytes = 0;
+        double total_pause_ms = 0;
+        double max_pause_ms = 0;
+    };
+
+    // anything holding Values outside the heap (an engine's frames and stacks);
+    // registered to the Heap so that a collection starts from it.
+    class GcRoots {
+    public:
+        virtual void mark_roots(Heap& heap) = 0;
+    protected:
+        ~GcRoots() = default;
+    };
+
+    // mark-sweep collector for runtime objects. a collection runs inside make()
+    // once the allocated bytes reach the threshold; afterwards the threshold
+    // becomes live bytes * `growth`, but never less than `min_threshold`.
+    // any thread may allocate; collections wait until no parallel task runs (see
+    // parallel.hpp), since the roots of a running task are not known.
+    class Heap {
+    private:
+        mutable std::recursive_mutex lock;     // recursive: a swept CodeObject unpins its literals
+        size_t paused = 0;
+        Object* objects = nullptr;
+        std::vector<GcRoots*> roots;
+        std::vector<const Object*> gray;
+        size_t allocated = 0;
+        size_t shared = 0;      // bytes reported by mark_shared() in this collection
+        size_t threshold;
+        size_t min_threshold;
+        double growth = 2.0;
+        GcStats statistics;
+
+        void sweep();
+        void collect_locked();
+
+    public:
+        Heap(size_t min_threshold = 1 << 20);
+        ~Heap();
+        Heap(const Heap&) = delete;
+        Heap& operator=(const Heap&) = delete;
+
+        template <typename T, typename... Args>
+        T* make(Args&&... args) {
+            std::lock_guard<std::recursive_mutex> guard(this->lock);
+            if (this->allocated >= this->threshold && this->paused == 0) this->collect_locked();
+            T* object = new T(std::forward<Args>(args)...);
+            object->next = this->objects;
+            this->objects = object;
+            size_t bytes = object->footprint();
+            this->allocated += bytes;
+            this->statistics.allocated_objects++;
+            this->statistics.allocated_bytes += bytes;
+            return object;
+        }
+
+        void configure(size_t min_threshold, double growth);
+        void add_roots(GcRoots* source);
+        void remove_roots(GcRoots* source);
+
+        // a pinned object is a root until it is unpinned; literals of the AST are pinned.
+        void pin(const Value& value);
+        void unpin(const Value& value);
+
+        void mark(const Object* object);
+        void mark(const Value& value);
+        // counts C++ data kept by several objects (see collection.hpp) as live, once per
+        // collection, since footprint() only has the part each object added.
+        void mark_shared(size_t bytes) { this->shared += bytes; }
+        void collect();
+        // collections are put off from the first pause until as many resumes
+        void pause_collections();
+        void resume_collections();
+
+        // differs between collections; lets objects sharing C++ data mark it once per collection
+        size_t epoch() const { return this->statistics.collections + 1; }
+
+        size_t bytes_allocated() const;
+        GcStats stats() const;
+        void print_stats(std::ostream& out) const;
+    };
+
+    // heap of the calling thread: the one given to use_heap(), or else the global one
+    Heap& heap();
+    // nullptr goes back to the global heap; objects must not move between heaps
+    void use_heap(Heap* heap);
+
+} // namespace lisp
+
+#endif
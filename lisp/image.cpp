@@ -0,0 +1,468 @@
+#include "image.hpp"
+
+#include "astnode.hpp"
+#include "collection.hpp"
+#include "heap.hpp"
+#include "source.hpp"
+#include "vector.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lisp {
+
+    static const char MAGIC[8] = {'L', 'I', 'S', 'P', 'I', 'M', 'G', '\0'};
+    static const std::uint32_t VERSION = 1;
+
+    // FNV-1a of everything after the header; catches damaged files, not crafted ones
+    static std::uint64_t __checksum(std::string_view bytes) {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (char byte : bytes) {
+            hash ^= (unsigned char)byte;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    [[noreturn]] static void __broken() {
+        throw SyntaxError(ErrorCode::Image, "[image error] Image is broken.");
+    }
+
+    /* ImageWriter */
+    class ImageWriter {
+    private:
+        std::string bytes;
+        std::unordered_map<const Object*, std::uint32_t> objects;
+        std::vector<const Object*> order;           // every object after its parts
+        std::unordered_map<const FunctionNode*, std::uint32_t> functions;
+        std::vector<const FunctionNode*> function_order;
+
+        template <typename T>
+        void raw(T value) {
+            this->bytes.append((const char*)&value, sizeof(T));
+        }
+        void u8(std::uint8_t value) { this->raw(value); }
+        void u32(std::uint32_t value) { this->raw(value); }
+        void i32(std::int32_t value) { this->raw(value); }
+        void text(std::string_view value) {
+            this->u32((std::uint32_t)value.size());
+            this->bytes.append(value.data(), value.size());
+        }
+
+        void add_function(const FunctionNode* function);
+        void add_nested(const ASTNode* node);
+        std::vector<Value> parts(const Object* object);
+        void add(const Value& root);
+
+        void literal(const Literal& literal);
+        void value(const Value& value);
+        void node(const ASTNode* node);
+        void object(const Object* object);
+
+    public:
+        std::string write(Evaluator& evaluator);
+    };
+
+    void ImageWriter::add_function(const FunctionNode* function) {
+        if (this->functions.count(function)) return;
+        this->functions[function] = (std::uint32_t)this->function_order.size();
+        this->function_order.push_back(function);
+        this->add_nested(function->body);
+    }
+
+    // fn* inside a body are saved with it, even when no closure of them exists yet
+    void ImageWriter::add_nested(const ASTNode* node) {
+        if (node->kind == NodeKind::Function) {
+            this->add_function((const FunctionNode*)node);
+        } else if (node->kind == NodeKind::List) {
+            for (const ASTNode* sub_node : ((const ListNode*)node)->sub_nodes)
+                this->add_nested(sub_node);
+        }
+    }
+
+    std::vector<Value> ImageWriter::parts(const Object* object) {
+        switch (object->kind) {
+        case ObjectKind::Closure: {
+            auto closure = (const ClosureObject*)object;
+            this->add_function(closure->function);
+            return closure->captured;
+        }
+        case ObjectKind::Cons: {
+            auto cell = (const ConsObject*)object;
+            return {cell->head, cell->tail};
+        }
+        case ObjectKind::PersistentVector: {
+            auto vector = (const PersistentVectorObject*)object;
+            std::vector<Value> items;
+            items.reserve(vector->count);
+            for (size_t i = 0; i < vector->count; i++) items.push_back(vector->get(i));
+            return items;
+        }
+        case ObjectKind::HashMap:
+            return ((const HashMapObject*)object)->entries();
+        case ObjectKind::Future:
+            throw SyntaxError(ErrorCode::Image, "[image error] Future cannot be saved.");
+        default:
+            return {};
+        }
+    }
+
+    // objects are immutable once made, so the graph has no cycles; long lists are
+    // walked with an explicit stack
+    void ImageWriter::add(const Value& root) {
+        if (!root.is_object()) return;
+        std::vector<std::pair<const Object*, bool>> stack{{root.as_object(), false}};
+        while (!stack.empty()) {
+            auto [object, expanded] = stack.back();
+            stack.pop_back();
+            if (this->objects.count(object)) continue;
+            if (expanded) {
+                this->objects[object] = (std::uint32_t)this->order.size();
+                this->order.push_back(object);
+                continue;
+            }
+            stack.push_back({object, true});
+            for (const Value& part : this->parts(object))
+                if (part.is_object() && !this->objects.count(part.as_object()))
+                    stack.push_back({part.as_object(), false});
+        }
+    }
+
+    void ImageWriter::literal(const Literal& literal) {
+        this->u8((std::uint8_t)literal.index());
+        switch (literal.index()) {
+        case 0: this->i32(std::get<int>(literal)); break;
+        case 1: this->u8((std::uint8_t)std::get<char>(literal)); break;
+        case 2: this->text(std::get<std::string>(literal)); break;
+        case 3: this->u8(std::get<bool>(literal)); break;
+        default: break;
+        }
+    }
+
+    void ImageWriter::value(const Value& value) {
+        this->u8((std::uint8_t)value.type());
+        switch (value.type()) {
+        case ValueType::Object: this->u32(this->objects.at(value.as_object())); break;
+        case ValueType::Int: this->i32(value.as_int()); break;
+        case ValueType::Char: this->u8((std::uint8_t)value.as_char()); break;
+        case ValueType::Bool: this->u8(value.as_bool()); break;
+        case ValueType::Null: break;
+        }
+    }
+
+    void ImageWriter::node(const ASTNode* node) {
+        this->u8((std::uint8_t)node->kind);
+        switch (node->kind) {
+        case NodeKind::Literal:
+            this->literal(((const LiteralNode*)node)->literal);
+            break;
+        case NodeKind::Symbol: {
+            auto symbol = (const SymbolNode*)node;
+            this->u32(symbol->symbol_id);
+            this->i32(symbol->depth);
+            this->i32(symbol->slot);
+            break;
+        }
+        case NodeKind::List: {
+            auto& sub_nodes = ((const ListNode*)node)->sub_nodes;
+            this->u32((std::uint32_t)sub_nodes.size());
+            for (const ASTNode* sub_node : sub_nodes) this->node(sub_node);
+            break;
+        }
+        case NodeKind::Function:
+            this->u32(this->functions.at((const FunctionNode*)node));
+            break;
+        }
+    }
+
+    void ImageWriter::object(const Object* object) {
+        this->u8((std::uint8_t)object->kind);
+        switch (object->kind) {
+        case ObjectKind::String:
+            this->text(((const StringObject*)object)->text);
+            break;
+        case ObjectKind::Native:
+            this->text(((const NativeObject*)object)->name);
+            break;
+        case ObjectKind::Vector: {
+            auto vector = (const VectorObject*)object;
+            this->u32((std::uint32_t)vector->length);
+            this->bytes.append((const char*)vector->data, vector->length * sizeof(int));
+            break;
+        }
+        case ObjectKind::Closure: {
+            auto closure = (const ClosureObject*)object;
+            this->u32(this->functions.at(closure->function));
+            this->u32((std::uint32_t)closure->captured.size());
+            for (const Value& value : closure->captured) this->value(value);
+            break;
+        }
+        default: {
+            // lists, vectors and maps: their parts, in the order of parts()
+            std::vector<Value> parts = this->parts(object);
+            this->u32((std::uint32_t)parts.size());
+            for (const Value& value : parts) this->value(value);
+            break;
+        }
+        }
+    }
+
+    std::string ImageWriter::write(Evaluator& evaluator) {
+        const Environment::Table& globals = evaluator.globals.symbols();
+        for (const Value& value : globals.values) this->add(value);
+
+        this->bytes.append(MAGIC, sizeof(MAGIC));
+        this->u32(VERSION);
+        this->raw<std::uint64_t>(0);
+        size_t header = this->bytes.size();
+
+        size_t symbols = symbol_table().size();
+        this->u32((std::uint32_t)symbols);
+        for (size_t i = 0; i < symbols; i++) this->text(symbol_name((SymbolId)i));
+
+        this->u32((std::uint32_t)this->function_order.size());
+        for (const FunctionNode* function : this->function_order) {
+            this->u32((std::uint32_t)function->parameters.size());
+            for (SymbolId parameter : function->parameters) this->u32(parameter);
+            this->u32((std::uint32_t)function->captures.size());
+            for (auto& capture : function->captures) {
+                this->i32(capture.first);
+                this->i32(capture.second);
+            }
+            this->node(function->body);
+        }
+
+        this->u32((std::uint32_t)this->order.size());
+        for (const Object* object : this->order) this->object(object);
+
+        this->u32((std::uint32_t)globals.size());
+        for (size_t i = 0; i < globals.size(); i++) {
+            this->u32(globals.names[i]);
+            this->value(globals.values[i]);
+        }
+        std::uint64_t checksum = __checksum(std::string_view(this->bytes).substr(header));
+        std::memcpy(&this->bytes[header - sizeof(checksum)], &checksum, sizeof(checksum));
+        return std::move(this->bytes);
+    }
+
+    void save_image(const std::string& filename, Evaluator& evaluator) {
+        std::string bytes = ImageWriter().write(evaluator);
+        std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+        if (!file.is_open() || !file.write(bytes.data(), bytes.size()))
+            throw SyntaxError(ErrorCode::Image, "[image error] Image file is inaccessible.");
+    }
+
+    /* ImageReader */
+    class ImageReader {
+    private:
+        std::string_view bytes;
+        size_t pos = 0;
+        std::vector<SymbolId> symbols;              // id in the image -> id in this process
+        std::vector<FunctionNode*> functions;
+        std::vector<Value> objects;
+        std::unordered_map<std::string_view, Value> natives;
+        Arena* arena = nullptr;
+
+        template <typename T>
+        T raw() {
+            if (this->bytes.size() - this->pos < sizeof(T)) __broken();
+            T value;
+            std::memcpy(&value, this->bytes.data() + this->pos, sizeof(T));
+            this->pos += sizeof(T);
+            return value;
+        }
+        std::uint8_t u8() { return this->raw<std::uint8_t>(); }
+        std::uint32_t u32() { return this->raw<std::uint32_t>(); }
+        std::int32_t i32() { return this->raw<std::int32_t>(); }
+        std::string_view text() {
+            std::uint32_t size = this->u32();
+            if (this->bytes.size() - this->pos < size) __broken();
+            std::string_view value = this->bytes.substr(this->pos, size);
+            this->pos += size;
+            return value;
+        }
+        // a count of items which take at least `least` bytes each
+        std::uint32_t count(size_t least) {
+            std::uint32_t count = this->u32();
+            if ((this->bytes.size() - this->pos) / least < count) __broken();
+            return count;
+        }
+        SymbolId symbol() {
+            std::uint32_t index = this->u32();
+            if (index >= this->symbols.size()) __broken();
+            return this->symbols[index];
+        }
+        FunctionNode* function() {
+            std::uint32_t index = this->u32();
+            if (index >= this->functions.size()) __broken();
+            return this->functions[index];
+        }
+
+        Literal literal();
+        Value value();
+        ASTNode* node();
+        Value object();
+
+    public:
+        ImageReader(std::string_view bytes) : bytes(bytes) {}
+        void read(Evaluator& evaluator);
+    };
+
+    Literal ImageReader::literal() {
+        switch (this->u8()) {
+        case 0: return Literal(std::in_place_index<0>, this->i32());
+        case 1: return Literal(std::in_place_index<1>, (char)this->u8());
+        case 2: return Literal(std::in_place_index<2>, std::string(this->text()));
+        case 3: return Literal(std::in_place_index<3>, this->u8() != 0);
+        case 4: return Literal(std::in_place_index<4>, nullptr);
+        default: __broken();
+        }
+    }
+
+    Value ImageReader::value() {
+        switch ((ValueType)this->u8()) {
+        case ValueType::Object: {
+            std::uint32_t index = this->u32();
+            if (index >= this->objects.size()) __broken();
+            return this->objects[index];
+        }
+        case ValueType::Int: return Value::integer(this->i32());
+        case ValueType::Char: return Value::character((char)this->u8());
+        case ValueType::Bool: return Value::boolean(this->u8() != 0);
+        case ValueType::Null: return Value::null();
+        default: __broken();
+        }
+    }
+
+    ASTNode* ImageReader::node() {
+        switch ((NodeKind)this->u8()) {
+        case NodeKind::Literal:
+            return this->arena->make<LiteralNode>(this->literal());
+        case NodeKind::Symbol: {
+            SymbolNode* symbol = this->arena->make<SymbolNode>(this->symbol());
+            symbol->depth = this->i32();
+            symbol->slot = this->i32();
+            return symbol;
+        }
+        case NodeKind::List: {
+            std::vector<ASTNode*> sub_nodes(this->count(1));
+            for (ASTNode*& sub_node : sub_nodes) sub_node = this->node();
+            return this->arena->make<ListNode>(std::move(sub_nodes));
+        }
+        case NodeKind::Function:
+            return this->function();
+        default:
+            __broken();
+        }
+    }
+
+    Value ImageReader::object() {
+        ObjectKind kind = (ObjectKind)this->u8();
+        switch (kind) {
+        case ObjectKind::String:
+            return Value::string(this->text());
+        case ObjectKind::Native: {
+            auto it = this->natives.find(this->text());
+            if (it == this->natives.end())
+                throw SyntaxError(ErrorCode::Image, "[image error] Native function of the image is not defined.");
+            return it->second;
+        }
+        case ObjectKind::Vector: {
+            std::uint32_t length = this->count(sizeof(int));
+            VectorObject* vector = heap().make<VectorObject>(length);
+            std::memcpy(vector->data, this->bytes.data() + this->pos, length * sizeof(int));
+            this->pos += length * sizeof(int);
+            return Value(vector);
+        }
+        case ObjectKind::Closure: {
+            ClosureObject* closure = heap().make<ClosureObject>(this->function());
+            closure->captured.resize(this->count(1));
+            for (Value& value : closure->captured) value = this->value();
+            return Value(closure);
+        }
+        case ObjectKind::Cons:
+        case ObjectKind::PersistentVector:
+        case ObjectKind::HashMap: {
+            std::vector<Value> parts(this->count(1));
+            for (Value& value : parts) value = this->value();
+            if (kind == ObjectKind::Cons) {
+                if (parts.size() != 2 || !(parts[1].is(ObjectKind::Cons) || parts[1].type() == ValueType::Null)) __broken();
+                return Value(heap().make<ConsObject>(parts[0], parts[1]));
+            }
+            if (kind == ObjectKind::PersistentVector) return make_vector(parts.data(), parts.size());
+            if (parts.size() % 2 != 0) __broken();
+            return make_map(parts.data(), parts.size());
+        }
+        default:
+            __broken();
+        }
+    }
+
+    // nothing made here is reachable from a root before the globals are defined, so
+    // collections are paused until then
+    void ImageReader::read(Evaluator& evaluator) {
+        if (this->bytes.size() < sizeof(MAGIC) || std::memcmp(this->bytes.data(), MAGIC, sizeof(MAGIC)) != 0) __broken();
+        this->pos = sizeof(MAGIC);
+        if (this->u32() != VERSION)
+            throw SyntaxError(ErrorCode::Image, "[image error] Version of the image is not supported.");
+        std::uint64_t checksum = this->raw<std::uint64_t>();
+        if (__checksum(this->bytes.substr(this->pos)) != checksum) __broken();
+
+        this->symbols.resize(this->count(4));
+        for (SymbolId& symbol : this->symbols) symbol = intern(this->text());
+
+        for (const Value& value : evaluator.globals.symbols().values)
+            if (value.is_native()) this->natives[value.as_native()->name] = value;
+
+        struct Pause {
+            Pause() { heap().pause_collections(); }
+            ~Pause() { heap().resume_collections(); }
+        } pause;
+
+        // every FunctionNode exists before the bodies are read, since a body may have any of them
+        auto arena = std::make_unique<Arena>();
+        this->arena = arena.get();
+        this->functions.resize(this->count(9));
+        for (FunctionNode*& function : this->functions)
+            function = this->arena->make<FunctionNode>(std::vector<SymbolId>(), nullptr);
+        for (FunctionNode* function : this->functions) {
+            function->parameters.resize(this->count(4));
+            for (SymbolId& parameter : function->parameters) parameter = this->symbol();
+            function->captures.resize(this->count(8));
+            for (auto& capture : function->captures) {
+                capture.first = this->i32();
+                capture.second = this->i32();
+            }
+            function->body = this->node();
+        }
+        if (!this->functions.empty()) {
+            CodeObject* code = heap().make<CodeObject>(std::move(arena));
+            for (FunctionNode* function : this->functions) function->owner = code;
+        }
+
+        // pushed one by one, so that a part which is not read yet is an error
+        std::uint32_t objects = this->count(1);
+        this->objects.reserve(objects);
+        for (std::uint32_t i = 0; i < objects; i++) this->objects.push_back(this->object());
+
+        std::uint32_t globals = this->count(2);
+        for (std::uint32_t i = 0; i < globals; i++) {
+            SymbolId name = this->symbol();
+            evaluator.define(name, this->value());
+        }
+    }
+
+    void load_image(const std::string& filename, Evaluator& evaluator) {
+        MappedFile mapped;
+        if (!mapped.open(filename))
+            throw SyntaxError(ErrorCode::Image, "[image error] Image file is inaccessible.");
+        ImageReader(mapped.view()).read(evaluator);
+    }
+
+} // namespace lisp
@@ -0,0 +1,31 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+#include "evaluator.hpp"
+
+#include <string>
+
+namespace lisp {
+
+    // binary snapshot of the globals of an Evaluator: the symbol names, then every
+    // function (its AST, already resolved), every object reachable from a global, and
+    // the bindings. objects come after the ones they refer to, so that a loader builds
+    // each one once with its parts at hand. numbers are in the byte order of the machine,
+    // and a checksum after the version catches damaged files; an image is meant to be
+    // loaded by the build which wrote it.
+    //
+    // natives are saved by name and bound again to the natives of the loading evaluator;
+    // bytecode is not saved, since the VM compiles a function when it first calls it.
+    // futures cannot be saved.
+
+    // throws `[image error] ...` when the file cannot be written or a global cannot be saved.
+    void save_image(const std::string& filename, Evaluator& evaluator);
+
+    // defines the globals of the image in `evaluator`, replacing bindings of the same
+    // names; the file is read through a MappedFile. throws `[image error] ...` for an
+    // inaccessible or broken image.
+    void load_image(const std::string& filename, Evaluator& evaluator);
+
+} // namespace lisp
+
+#endif
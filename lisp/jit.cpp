@@ -0,0 +1,267 @@
+#include "jit.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#ifdef LISP_HAS_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace lisp {
+
+    std::uint32_t Jit::hot = 1000;
+
+    static std::atomic<size_t> compiled{0};
+    static std::atomic<size_t> compiled_bytes{0};
+    static std::atomic<size_t> bailouts{0};
+    static std::atomic<size_t> deoptimized{0};
+
+    static_assert(sizeof(Value) == 8, "the JIT reads a Value as one word");
+
+    bool Jit::supported() {
+#ifdef LISP_HAS_JIT
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void Jit::set_threshold(std::uint32_t threshold) {
+        hot = threshold > 0 ? threshold : 1;
+    }
+
+    // a list bailing out in more than a quarter of its runs goes back to the interpreter
+    bool Jit::bail(ListNode* node) {
+        JitCode* code = node->native;
+        bailouts++;
+        if (++code->bails >= 16 && code->bails * 4 > code->runs) {
+            node->native = nullptr;
+            node->hits = NEVER;
+            release(code);
+            deoptimized++;
+        }
+        return false;
+    }
+
+    void Jit::print_stats(std::ostream& out) {
+        out << "{Jit} compiled: " << compiled << " lists / " << compiled_bytes << " bytes"
+            << ", bailouts: " << bailouts << ", deoptimized: " << deoptimized << "\n";
+    }
+
+#ifdef LISP_HAS_JIT
+    /* Assembler */
+    // templates of x86-64 code: every list leaves its value in rax, and operands wait
+    // on the machine stack. rsi, rdi: arguments; r9: `out`; r10: rsp at entry.
+    class Assembler {
+    private:
+        std::vector<std::uint8_t> code;
+        std::vector<size_t> to_bail;        // rel32 fields of jumps to the bailout
+        int nodes = 0;
+
+        static const int MAX_NODES = 512;
+        static const int MAX_DEPTH = 64;
+
+        void bytes(std::initializer_list<std::uint8_t> list) {
+            this->code.insert(this->code.end(), list);
+        }
+        void imm32(std::int32_t value) {
+            std::uint8_t raw[4];
+            std::memcpy(raw, &value, 4);
+            this->code.insert(this->code.end(), raw, raw + 4);
+        }
+        // jcc rel32 to the bailout
+        void bail_if(std::uint8_t condition) {
+            this->bytes({0x0F, condition});
+            this->to_bail.push_back(this->code.size());
+            this->imm32(0);
+        }
+        void load_int(std::int32_t value) {
+            this->bytes({0x48, 0xC7, 0xC0});        // mov rax, imm32
+            this->imm32(value);
+        }
+        void check_int32() {
+            this->bytes({0x48, 0x63, 0xC8});        // movsxd rcx, eax
+            this->bytes({0x48, 0x39, 0xC1});        // cmp rcx, rax
+            this->bail_if(0x85);                    // jne
+        }
+        // the next operand in rax, the one before it popped into rax and the next one in rcx
+        void second_operand(ASTNode* node, int depth, bool& ok) {
+            this->bytes({0x50});                    // push rax
+            this->expression(node, depth + 1, ok);
+            this->bytes({0x48, 0x89, 0xC1});        // mov rcx, rax
+            this->bytes({0x58});                    // pop rax
+        }
+        void divide() {
+            this->bytes({0x48, 0x85, 0xC9});        // test rcx, rcx
+            this->bail_if(0x84);                    // jz
+            this->bytes({0x48, 0x99});              // cqo
+            this->bytes({0x48, 0xF7, 0xF9});        // idiv rcx
+        }
+
+        void local(SymbolNode* symbol) {
+            this->bytes({0x48, 0x8B, 0x8E});        // mov rcx, [rsi - 8 * (depth + 1)]
+            this->imm32(-8 * (symbol->depth + 1));
+            this->bytes({0x48, 0x8B, 0x84, 0xCF});  // mov rax, [rdi + rcx * 8 + 8 * slot]
+            this->imm32(8 * symbol->slot);
+            this->bytes({0x49, 0x89, 0xC0});        // mov r8, rax
+            this->bytes({0x41, 0x83, 0xE0, 0x07});  // and r8d, 7
+            this->bytes({0x41, 0x83, 0xF8, (std::uint8_t)ValueType::Int});     // cmp r8d, Int
+            this->bail_if(0x85);                    // jne
+            this->bytes({0x48, 0xC1, 0xF8, 0x20});  // sar rax, 32
+        }
+
+        void arithmetic(SymbolId oper, const std::vector<ASTNode*>& operands, int depth, bool& ok) {
+            size_t count = operands.size() - 1;
+            if (count == 0) {
+                if (oper == SYM_SUB || oper == SYM_DIV) ok = false;
+                this->load_int(oper == SYM_MUL ? 1 : 0);
+                return;
+            }
+            this->expression(operands[1], depth + 1, ok);
+            if (count == 1 && oper == SYM_SUB) {
+                this->bytes({0x48, 0xF7, 0xD8});    // neg rax
+            } else if (count == 1 && oper == SYM_DIV) {
+                this->bytes({0x48, 0x89, 0xC1});    // mov rcx, rax
+                this->load_int(1);
+                this->divide();
+            }
+            for (size_t i = 2; i < operands.size(); i++) {
+                this->second_operand(operands[i], depth, ok);
+                switch (oper) {
+                case SYM_ADD: this->bytes({0x48, 0x01, 0xC8}); break;       // add rax, rcx
+                case SYM_SUB: this->bytes({0x48, 0x29, 0xC8}); break;       // sub rax, rcx
+                case SYM_MUL:
+                    this->bytes({0x48, 0x0F, 0xAF, 0xC1});                  // imul rax, rcx
+                    this->bail_if(0x80);                                    // jo
+                    break;
+                default: this->divide(); break;
+                }
+            }
+            this->check_int32();
+        }
+
+        void compare(SymbolId oper, const std::vector<ASTNode*>& operands, int depth, bool& ok) {
+            if (operands.size() != 3) {
+                ok = false;
+                return;
+            }
+            this->expression(operands[1], depth + 1, ok);
+            this->second_operand(operands[2], depth, ok);
+            this->bytes({0x48, 0x39, 0xC8});        // cmp rax, rcx
+            this->bytes({0x0F, (std::uint8_t)(oper == SYM_EQ ? 0x94 : 0x9C), 0xC0});   // sete / setl al
+            this->bytes({0x0F, 0xB6, 0xC0});        // movzx eax, al
+        }
+
+        // an operand of arithmetic: an Int in rax
+        void expression(ASTNode* node, int depth, bool& ok) {
+            if (!ok || ++this->nodes > MAX_NODES || depth > MAX_DEPTH) {
+                ok = false;
+                return;
+            }
+            switch (node->kind) {
+            case NodeKind::Literal: {
+                Value value = ((LiteralNode*)node)->value;
+                if (!value.is_int()) ok = false;
+                else this->load_int(value.as_int());
+                return;
+            }
+            case NodeKind::Symbol: {
+                SymbolNode* symbol = (SymbolNode*)node;
+                if (symbol->depth < 0) ok = false;
+                else this->local(symbol);
+                return;
+            }
+            case NodeKind::List: {
+                auto& sub_nodes = ((ListNode*)node)->sub_nodes;
+                if (sub_nodes.empty() || sub_nodes[0]->kind != NodeKind::Symbol) {
+                    ok = false;
+                    return;
+                }
+                SymbolId oper = ((SymbolNode*)sub_nodes[0])->symbol_id;
+                if (oper >= SYM_ADD && oper <= SYM_DIV) this->arithmetic(oper, sub_nodes, depth, ok);
+                else ok = false;
+                return;
+            }
+            default:
+                ok = false;
+                return;
+            }
+        }
+
+    public:
+        // false if the list is not arithmetic over Int literals and locals
+        bool compile(ListNode* node, bool& boolean) {
+            auto& sub_nodes = node->sub_nodes;
+            if (sub_nodes.empty() || sub_nodes[0]->kind != NodeKind::Symbol) return false;
+            SymbolId oper = ((SymbolNode*)sub_nodes[0])->symbol_id;
+
+            this->bytes({0x49, 0x89, 0xD1});        // mov r9, rdx
+            this->bytes({0x49, 0x89, 0xE2});        // mov r10, rsp
+            bool ok = true;
+            boolean = oper == SYM_EQ || oper == SYM_LT;
+            if (boolean) this->compare(oper, sub_nodes, 0, ok);
+            else if (oper >= SYM_ADD && oper <= SYM_DIV) this->arithmetic(oper, sub_nodes, 0, ok);
+            else ok = false;
+            if (!ok) return false;
+            this->bytes({0x49, 0x89, 0x01});        // mov [r9], rax
+            this->bytes({0x31, 0xC0});              // xor eax, eax
+            this->bytes({0xC3});                    // ret
+
+            size_t bail = this->code.size();
+            this->bytes({0x4C, 0x89, 0xD4});        // mov rsp, r10
+            this->bytes({0xB8, 0x01, 0x00, 0x00, 0x00});    // mov eax, 1
+            this->bytes({0xC3});                    // ret
+            for (size_t at : this->to_bail) {
+                std::int32_t offset = (std::int32_t)(bail - (at + 4));
+                std::memcpy(&this->code[at], &offset, 4);
+            }
+            return true;
+        }
+
+        const std::vector<std::uint8_t>& bytes() const { return this->code; }
+    };
+
+    JitCode* Jit::compile(ListNode* node) {
+        Assembler assembler;
+        bool boolean = false;
+        if (!assembler.compile(node, boolean)) return nullptr;
+
+        // a mapping of its own, never writable and executable at once
+        const std::vector<std::uint8_t>& bytes = assembler.bytes();
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t size = (bytes.size() + page - 1) / page * page;
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) return nullptr;
+        std::memcpy(memory, bytes.data(), bytes.size());
+        if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory, size);
+            return nullptr;
+        }
+        compiled++;
+        compiled_bytes += bytes.size();
+
+        JitCode* code = new JitCode();
+        code->function = (JitFunction)memory;
+        code->memory = memory;
+        code->size = size;
+        code->boolean = boolean;
+        return code;
+    }
+
+    void Jit::release(JitCode* code) {
+        munmap(code->memory, code->size);
+        delete code;
+    }
+#else
+    JitCode* Jit::compile(ListNode*) {
+        return nullptr;
+    }
+
+    void Jit::release(JitCode* code) {
+        delete code;
+    }
+#endif
+
+} // namespace lisp
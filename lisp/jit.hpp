@@ -0,0 +1,78 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include "astnode.hpp"
+#include "value.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define LISP_HAS_JIT 1
+#endif
+
+namespace lisp {
+
+    // compiled code of one ListNode; returns 0 with the result in `*out`, or 1 when a
+    // guard failed. `frames_top` is one past the last frame index of the Evaluator.
+    typedef int (*JitFunction)(const Value* slots, const size_t* frames_top, std::int64_t* out);
+
+    struct JitCode {
+        JitFunction function;
+        void* memory;
+        size_t size;
+        bool boolean;           // the result of `=` and `<`
+        std::uint32_t runs = 0;
+        std::uint32_t bails = 0;
+    };
+
+    // template JIT of the tree walker for Linux x86-64. a `+ - * / = <` list whose
+    // operands are Int literals, locals and such lists again is counted each time the
+    // Evaluator reaches it; at `threshold()` it becomes machine code in a page of its own,
+    // written and then made executable. every local is checked to be an Int, and every
+    // result to fit in one; on overflow, division by zero or another type the code bails
+    // out and the Evaluator runs the list again, so errors are those of the interpreter.
+    // a list which keeps bailing out is given back to the interpreter for good.
+    //
+    // a ListNode is only counted and run by the thread of the root Evaluator, which owns
+    // its script: pool workers never enable the JIT.
+    class Jit {
+    private:
+        static std::uint32_t hot;
+        static JitCode* compile(ListNode* node);
+        static bool bail(ListNode* node);
+    public:
+        static constexpr std::uint32_t NEVER = UINT32_MAX;     // hits of a list which is not compiled
+
+        static bool supported();
+        static std::uint32_t threshold() { return hot; }
+        // before any script runs
+        static void set_threshold(std::uint32_t threshold);
+        static void release(JitCode* code);
+
+        // true with the value of the list in `result`; false when the Evaluator evaluates it
+        static bool evaluate(ListNode* node, const Value* slots, const size_t* frames_top, Value& result) {
+            JitCode* code = node->native;
+            if (code == nullptr) {
+                if (node->hits >= hot || ++node->hits < hot) return false;
+                code = node->native = compile(node);
+                if (code == nullptr) {
+                    node->hits = NEVER;
+                    return false;
+                }
+            }
+            std::int64_t out;
+            code->runs++;
+            if (code->function(slots, frames_top, &out) != 0) return bail(node);
+            result = code->boolean ? Value::boolean(out != 0) : Value::integer((int)out);
+            return true;
+        }
+
+        // compiled lists, their bytes, bailouts and lists given back to the interpreter
+        static void print_stats(std::ostream& out);
+    };
+
+} // namespace lisp
+
+#endif
@@ -0,0 +1,80 @@
+#include "lexer.hpp"
+
+namespace lisp {
+
+    bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    /* Lexer */
+    Lexer::Lexer(std::string_view source, SourcePosition start) : source(source), start(start), line(start.line) {}
+
+    Token Lexer::make(TokenKind kind, size_t begin, size_t end) const {
+        std::uint32_t column = (std::uint32_t)(begin - this->line_begin) + (this->line == this->start.line ? this->start.column : 1);
+        return Token{kind, begin, end, this->source.substr(begin, end - begin), SourcePosition{this->line, column}};
+    }
+
+    void Lexer::count_lines(size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (this->source[i] == '\n') {
+                this->line++;
+                this->line_begin = i + 1;
+            }
+        }
+    }
+
+    Token Lexer::scan() {
+        const size_t size = this->source.size();
+        while (this->pos < size && is_space(this->source[this->pos])) {
+            if (this->source[this->pos] == '\n') {
+                this->line++;
+                this->line_begin = this->pos + 1;
+            }
+            this->pos++;
+        }
+        if (this->pos == size) return this->make(TokenKind::End, size, size);
+
+        size_t begin = this->pos;
+        char c = this->source[begin];
+        if (c == '(' || c == ')') {
+            this->pos++;
+            return this->make(c == '(' ? TokenKind::LeftParen : TokenKind::RightParen, begin, this->pos);
+        }
+        if (c == '"' || c == '\'') {
+            size_t close = this->source.find(c, begin + 1);
+            if (close == std::string_view::npos) {
+                this->pos = size;
+                return this->make(TokenKind::Invalid, begin, size);
+            }
+            // the token keeps the position of its first line
+            Token token = this->make(c == '"' ? TokenKind::String : TokenKind::Char, begin, close + 1);
+            this->count_lines(begin, close);
+            this->pos = close + 1;
+            if (c == '\'' && this->pos - begin != 3) token.kind = TokenKind::Invalid;
+            return token;
+        }
+        while (this->pos < size) {
+            c = this->source[this->pos];
+            if (is_space(c) || c == '(' || c == ')' || c == '\'' || c == '"') break;
+            this->pos++;
+        }
+        return this->make(TokenKind::Atom, begin, this->pos);
+    }
+
+    Token Lexer::next() {
+        if (this->has_peeked) {
+            this->has_peeked = false;
+            return this->peeked;
+        }
+        return this->scan();
+    }
+
+    Token Lexer::peek() {
+        if (!this->has_peeked) {
+            this->peeked = this->scan();
+            this->has_peeked = true;
+        }
+        return this->peeked;
+    }
+
+} // namespace lisp
@@ -0,0 +1,51 @@
+#ifndef LEXER_HPP
+#define LEXER_HPP
+
+#include "error.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace lisp {
+
+    // Invalid: a string or character without its closing quote, or a character of
+    // more than one letter; the Lexer goes on after it.
+    enum class TokenKind : std::uint8_t { LeftParen, RightParen, String, Char, Atom, Invalid, End };
+
+    // a token never owns its text; `text` points into the source given to the Lexer.
+    struct Token {
+        TokenKind kind;
+        size_t begin;
+        size_t end;
+        std::string_view text;
+        SourcePosition position;
+    };
+
+    class Lexer {
+    private:
+        std::string_view source;
+        size_t pos = 0;
+        bool has_peeked = false;
+        Token peeked;
+        // the line of `pos` and where it starts in `source`; the first line starts at `start.column`
+        SourcePosition start;
+        std::uint32_t line;
+        size_t line_begin = 0;
+
+        Token scan();
+        Token make(TokenKind kind, size_t begin, size_t end) const;
+        void count_lines(size_t begin, size_t end);
+
+    public:
+        // `start` is the position of the source in its file
+        Lexer(std::string_view source, SourcePosition start = SourcePosition{1, 1});
+        Token next();
+        Token peek();
+    };
+
+    bool is_space(char c);
+
+} // namespace lisp
+
+#endif
@@ -3,8 +3,27 @@
 
 #include "parser.hpp"
 #include "astnode.hpp"
+#include "value.hpp"
+#include "heap.hpp"
+#include "symbol.hpp"
 #include "error.hpp"
 #include "environment.hpp"
 #include "evaluator.hpp"
+#include "lexer.hpp"
+#include "reader.hpp"
+#include "source.hpp"
+#include "bytecode.hpp"
+#include "vm.hpp"
+#include "optimizer.hpp"
+#include "simd.hpp"
+#include "vector.hpp"
+#include "collection.hpp"
+#include "parallel.hpp"
+#include "batch.hpp"
+#include "image.hpp"
+#include "profiler.hpp"
+#include "jit.hpp"
+#include "cache.hpp"
+#include "server.hpp"
 
 #endif
\ No newline at end of file
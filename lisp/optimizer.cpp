@@ -0,0 +1,214 @@
+#include "optimizer.hpp"
+
+namespace lisp {
+
+    /* Optimizer */
+    Optimizer::Optimizer(Arena& arena) : arena(arena) {}
+
+    Optimizer::Binding* Optimizer::lookup(SymbolId name) {
+        for (auto it = this->scope.rbegin(); it != this->scope.rend(); it++)
+            if (it->name == name) return &*it;
+        return nullptr;
+    }
+
+    // `eager` is true when the node surely runs whenever the form does.
+    ASTNode* Optimizer::optimize_node(ASTNode* node, bool eager) {
+        switch (node->kind) {
+        case NodeKind::Literal:
+            return node;
+        case NodeKind::Symbol:
+            return this->optimize_symbol((SymbolNode*)node, true);
+        case NodeKind::Function:
+            return this->optimize_function((FunctionNode*)node);
+        case NodeKind::List:
+            break;
+        }
+
+        ListNode* list = (ListNode*)node;
+        std::vector<ASTNode*>& sub_nodes = list->sub_nodes;
+        // from here on, the node may fail or call a function
+        if (sub_nodes.size() == 0 || sub_nodes[0]->kind == NodeKind::Literal) {
+            this->clean = false;
+            return node;
+        }
+
+        if (sub_nodes[0]->kind == NodeKind::Symbol && ((SymbolNode*)sub_nodes[0])->symbol_id < SYM_BUILTIN_COUNT) {
+            SymbolId oper = ((SymbolNode*)sub_nodes[0])->symbol_id;
+            switch (oper) {
+            case SYM_DEF:
+                if (sub_nodes.size() == 3 && sub_nodes[1]->kind == NodeKind::Symbol)
+                    sub_nodes[2] = this->optimize_node(sub_nodes[2], eager);
+                this->clean = false;
+                return node;
+            case SYM_LET:
+                return this->optimize_let(list, eager);
+            case SYM_IF:
+                return this->optimize_if(list, eager);
+            case SYM_FN:
+                // a malformed fn*; it fails before evaluating anything
+                this->clean = false;
+                return node;
+            default:
+                return this->optimize_operator(list, oper, eager);
+            }
+        }
+
+        // function call; the head stays a symbol, so that a constant which is not a
+        // function still fails after the arguments are evaluated, as before.
+        for (size_t i = 0; i < sub_nodes.size(); i++) {
+            if (i == 0 && sub_nodes[0]->kind == NodeKind::Symbol)
+                sub_nodes[0] = this->optimize_symbol((SymbolNode*)sub_nodes[0], false);
+            else
+                sub_nodes[i] = this->optimize_node(sub_nodes[i], eager);
+        }
+        this->clean = false;
+        return node;
+    }
+
+    ASTNode* Optimizer::optimize_symbol(SymbolNode* symbol, bool substitute) {
+        Binding* binding = this->lookup(symbol->symbol_id);
+        if (binding == nullptr) {
+            // a global, which may be undefined
+            this->clean = false;
+            return symbol;
+        }
+        if (substitute && binding->value != nullptr)
+            return binding->value;
+        binding->used = true;
+        return symbol;
+    }
+
+    ASTNode* Optimizer::optimize_let(ListNode* list, bool eager) {
+        std::vector<ASTNode*>& sub_nodes = list->sub_nodes;
+        if (sub_nodes.size() != 3 || sub_nodes[1]->kind != NodeKind::List || ((ListNode*)sub_nodes[1])->sub_nodes.size() % 2 == 1) {
+            this->clean = false;
+            return list;
+        }
+
+        std::vector<ASTNode*>& parameters = ((ListNode*)sub_nodes[1])->sub_nodes;
+        size_t outer = this->scope.size();
+        for (size_t i = 0; i < parameters.size(); i += 2) {
+            if (parameters[i]->kind != NodeKind::Symbol) {
+                // fails here, after the bindings before; those are kept as they are
+                this->clean = false;
+                this->scope.resize(outer);
+                return list;
+            }
+            parameters[i + 1] = this->optimize_node(parameters[i + 1], eager);
+            LiteralNode* value = parameters[i + 1]->kind == NodeKind::Literal ? (LiteralNode*)parameters[i + 1] : nullptr;
+            this->scope.push_back({((SymbolNode*)parameters[i])->symbol_id, value, false});
+        }
+        sub_nodes[2] = this->optimize_node(sub_nodes[2], eager);
+
+        // drop the constants which are not read any more
+        std::vector<ASTNode*> kept;
+        for (size_t i = 0; i < parameters.size(); i += 2) {
+            Binding& binding = this->scope[outer + i / 2];
+            if (binding.value != nullptr && !binding.used) continue;
+            kept.push_back(parameters[i]);
+            kept.push_back(parameters[i + 1]);
+        }
+        this->scope.resize(outer);
+        if (kept.empty()) return sub_nodes[2];
+        parameters = std::move(kept);
+        return list;
+    }
+
+    ASTNode* Optimizer::optimize_if(ListNode* list, bool eager) {
+        std::vector<ASTNode*>& sub_nodes = list->sub_nodes;
+        if (sub_nodes.size() != 4) {
+            this->clean = false;
+            return list;
+        }
+
+        sub_nodes[1] = this->optimize_node(sub_nodes[1], eager);
+        if (sub_nodes[1]->kind == NodeKind::Literal) {
+            // false and null are false, every other value is true
+            const Value& condition = ((LiteralNode*)sub_nodes[1])->value;
+            bool truthy = condition.type() == ValueType::Bool ? condition.as_bool() : condition.type() != ValueType::Null;
+            return this->optimize_node(truthy ? sub_nodes[2] : sub_nodes[3], eager);
+        }
+
+        // only one branch runs; the form stays clean if both are
+        bool before = this->clean;
+        sub_nodes[2] = this->optimize_node(sub_nodes[2], false);
+        bool then_clean = this->clean;
+        this->clean = before;
+        sub_nodes[3] = this->optimize_node(sub_nodes[3], false);
+        this->clean = this->clean && then_clean;
+        return list;
+    }
+
+    ASTNode* Optimizer::optimize_operator(ListNode* list, SymbolId oper, bool eager) {
+        std::vector<ASTNode*>& sub_nodes = list->sub_nodes;
+        bool binary = oper == SYM_EQ || oper == SYM_LT;
+        if ((binary && sub_nodes.size() != 3) || (sub_nodes.size() == 1 && (oper == SYM_SUB || oper == SYM_DIV))) {
+            this->clean = false;
+            return list;
+        }
+
+        bool constant = true;
+        for (size_t i = 1; i < sub_nodes.size(); i++) {
+            sub_nodes[i] = this->optimize_node(sub_nodes[i], eager);
+            if (sub_nodes[i]->kind != NodeKind::Literal) constant = false;
+        }
+        for (size_t i = 1; i < sub_nodes.size(); i++) {
+            if (sub_nodes[i]->kind == NodeKind::Function || (sub_nodes[i]->kind == NodeKind::Literal && !((LiteralNode*)sub_nodes[i])->value.is_int())) {
+                // every operand is evaluated before the check, so only a clean form reports it now
+                if (eager && this->clean)
+                    throw SyntaxError(ErrorCode::Operator, "[operator error] Data type of operand is not Int.", list->position);
+                this->clean = false;
+                return list;
+            }
+        }
+        if (!constant) {
+            this->clean = false;
+            return list;
+        }
+
+        std::vector<Value> operands;
+        for (size_t i = 1; i < sub_nodes.size(); i++)
+            operands.push_back(((LiteralNode*)sub_nodes[i])->value);
+        LiteralNode* folded;
+        if (oper == SYM_EQ) {
+            folded = this->arena.make<LiteralNode>(operands[0].as_int() == operands[1].as_int());
+        } else if (oper == SYM_LT) {
+            folded = this->arena.make<LiteralNode>(operands[0].as_int() < operands[1].as_int());
+        } else {
+            Value result = arithmetic(oper, operands.data(), operands.size());
+            if (result.is_failure()) {
+                // overflow or division by zero
+                if (eager && this->clean) {
+                    locate_pending_error(list->position);
+                    throw_pending_error();
+                }
+                this->clean = false;
+                return list;
+            }
+            folded = this->arena.make<LiteralNode>(result.as_int());
+        }
+        folded->position = list->position;
+        return folded;
+    }
+
+    ASTNode* Optimizer::optimize_function(FunctionNode* function) {
+        // the body runs only when the function is called
+        bool before = this->clean;
+        size_t outer = this->scope.size();
+        for (SymbolId parameter : function->parameters)
+            this->scope.push_back({parameter, nullptr, false});
+        function->body = this->optimize_node(function->body, false);
+        this->scope.resize(outer);
+        this->clean = before;
+        return function;
+    }
+
+    void Optimizer::optimize(Parser& parser) {
+        Optimizer optimizer(*parser.arena);
+        for (ASTNode*& form : ((ListNode*)parser.root)->sub_nodes) {
+            optimizer.clean = true;
+            form = optimizer.optimize_node(form, true);
+        }
+    }
+
+} // namespace lisp
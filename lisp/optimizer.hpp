@@ -0,0 +1,50 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include "arena.hpp"
+#include "arithmetic.hpp"
+#include "astnode.hpp"
+#include "error.hpp"
+#include "parser.hpp"
+#include "symbol.hpp"
+
+#include <vector>
+
+namespace lisp {
+
+    // rewrites a parsed form before it runs:
+    // - an operator whose operands are all Int literals becomes its result,
+    // - an `if` whose condition is a literal becomes the branch it takes,
+    // - a local bound to a literal is replaced by that literal, and the binding is dropped.
+    // an operand which can never be Int, an overflow or a division by zero is reported
+    // here, but only when the error is certain and nothing evaluated before it could
+    // fail or define a global; otherwise the node is left for the evaluator, so errors
+    // come in the same order.
+    class Optimizer {
+    private:
+        struct Binding {
+            SymbolId name;
+            LiteralNode* value;     // nullptr unless the local is a constant
+            bool used;              // still read by a symbol which was not replaced
+        };
+        Arena& arena;
+        std::vector<Binding> scope;
+        // nothing evaluated so far may have failed or had side effects
+        bool clean = true;
+
+        Optimizer(Arena& arena);
+        Binding* lookup(SymbolId name);
+        ASTNode* optimize_node(ASTNode* node, bool eager);
+        ASTNode* optimize_symbol(SymbolNode* symbol, bool substitute);
+        ASTNode* optimize_let(ListNode* list, bool eager);
+        ASTNode* optimize_if(ListNode* list, bool eager);
+        ASTNode* optimize_operator(ListNode* list, SymbolId oper, bool eager);
+        ASTNode* optimize_function(FunctionNode* function);
+    public:
+        // optimizes every form under `parser.root`; new nodes are made in `parser.arena`.
+        static void optimize(Parser& parser);
+    };
+
+} // namespace lisp
+
+#endif
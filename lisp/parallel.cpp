@@ -0,0 +1,293 @@
+#include "parallel.hpp"
+
+#include "collection.hpp"
+#include "evaluator.hpp"
+#include "heap.hpp"
+
+#include <algorithm>
+#include <ostream>
+#include <utility>
+
+namespace lisp {
+
+    /* FutureObject */
+    FutureObject::FutureObject(Value callee, std::vector<Value> arguments)
+        : Object(ObjectKind::Future), callee(callee), arguments(std::move(arguments)) {}
+
+    void FutureObject::trace(Heap& heap) const {
+        heap.mark(this->callee);
+        for (const Value& value : this->arguments) heap.mark(value);
+        heap.mark(this->result);
+    }
+
+    size_t FutureObject::footprint() const {
+        return sizeof(FutureObject) + this->arguments.capacity() * sizeof(Value);
+    }
+
+    const char* FutureObject::type_name() const {
+        return "future";
+    }
+
+    void FutureObject::print(std::ostream& out) const {
+        out << "#<future>";
+    }
+
+    /* ThreadPool */
+    // index of the calling thread in its pool; -1 for threads which are not workers
+    static thread_local int worker_index = -1;
+    // tasks running on the calling thread; a waiting thread runs them inside its own work
+    static thread_local int running_tasks = 0;
+
+    bool in_parallel_task() {
+        return running_tasks > 0;
+    }
+
+    ThreadPool::ThreadPool(Evaluator& root, size_t threads) : owner(&heap()) {
+        for (size_t i = 1; i < threads; i++) {
+            auto worker = std::make_unique<Worker>();
+            worker->evaluator = std::make_unique<Evaluator>(&root);
+            this->workers.push_back(std::move(worker));
+        }
+        for (size_t i = 0; i < this->workers.size(); i++)
+            this->workers[i]->thread = std::thread(&ThreadPool::work, this, (int)i);
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->stopping = true;
+        }
+        this->wake.notify_all();
+        for (auto& worker : this->workers) worker->thread.join();
+        // tasks which never ran are dropped
+        for (size_t i = 0; i < this->unfinished; i++) this->owner->resume_collections();
+    }
+
+    size_t ThreadPool::size() const {
+        return this->workers.size() + 1;
+    }
+
+    FutureObject* ThreadPool::submit(Value callee, std::vector<Value> arguments) {
+        FutureObject* future = heap().make<FutureObject>(callee, std::move(arguments));
+        future->globals = Evaluator::current()->environment;
+        this->owner->pause_collections();
+        this->unfinished++;
+        // counted before it is queued, so that `queued` never goes below the real count
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->queued++;
+            if (worker_index < 0) this->injected.push_back(future);
+        }
+        if (worker_index >= 0) {
+            Worker& own = *this->workers[worker_index];
+            std::lock_guard<std::mutex> guard(own.lock);
+            own.tasks.push_back(future);
+        }
+        this->wake.notify_one();
+        this->finished.notify_all();
+        // without workers nothing else would run it before someone waits
+        if (this->workers.empty()) this->run_one(*Evaluator::current(), worker_index);
+        return future;
+    }
+
+    // own queue newest first, then the oldest injected task, then the oldest task of another worker
+    FutureObject* ThreadPool::take(int self) {
+        if (this->queued == 0) return nullptr;
+        FutureObject* task = nullptr;
+        if (self >= 0) {
+            Worker& own = *this->workers[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = own.tasks.back();
+                own.tasks.pop_back();
+            }
+        }
+        if (task == nullptr) {
+            std::lock_guard<std::mutex> guard(this->lock);
+            if (!this->injected.empty()) {
+                task = this->injected.front();
+                this->injected.pop_front();
+            }
+        }
+        size_t count = this->workers.size();
+        for (size_t i = 1; task == nullptr && i <= count; i++) {
+            Worker& victim = *this->workers[(std::max(self, 0) + i) % count];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+            }
+        }
+        if (task != nullptr) this->queued--;
+        return task;
+    }
+
+    bool ThreadPool::run_one(Evaluator& evaluator, int self) {
+        FutureObject* task = this->take(self);
+        if (task == nullptr) return false;
+        this->execute(task, evaluator);
+        return true;
+    }
+
+    void ThreadPool::execute(FutureObject* task, Evaluator& evaluator) {
+        // the globals of the submitter, e.g. a session over those of the root evaluator
+        Environment* globals = evaluator.environment;
+        evaluator.environment = task->globals;
+        running_tasks++;
+        try {
+            task->result = evaluator.apply(task->callee, task->arguments.data(), task->arguments.size());
+        } catch (...) {
+            task->error = std::current_exception();
+        }
+        running_tasks--;
+        evaluator.environment = globals;
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            task->done = true;
+            this->unfinished--;
+        }
+        this->finished.notify_all();
+        // from here `task` may be collected unless the caller still keeps it
+        this->owner->resume_collections();
+    }
+
+    void ThreadPool::work(int self) {
+        worker_index = self;
+        use_heap(this->owner);
+        Evaluator& evaluator = *this->workers[self]->evaluator;
+        Evaluator::set_current(&evaluator);
+        while (true) {
+            if (this->run_one(evaluator, self)) continue;
+            std::unique_lock<std::mutex> guard(this->lock);
+            this->wake.wait(guard, [this] { return this->stopping || this->queued > 0; });
+            if (this->stopping) return;
+        }
+    }
+
+    Value ThreadPool::wait(FutureObject* future, Evaluator& evaluator) {
+        while (!future->done) {
+            if (this->run_one(evaluator, worker_index)) continue;
+            std::unique_lock<std::mutex> guard(this->lock);
+            this->finished.wait(guard, [&] { return future->done || this->queued > 0; });
+        }
+        if (future->error) std::rethrow_exception(future->error);
+        return future->result;
+    }
+
+    void ThreadPool::finish(Evaluator& evaluator) {
+        while (this->busy()) {
+            if (this->run_one(evaluator, worker_index)) continue;
+            std::unique_lock<std::mutex> guard(this->lock);
+            this->finished.wait(guard, [this] { return this->unfinished == 0 || this->queued > 0; });
+        }
+    }
+
+    bool ThreadPool::busy() const {
+        return this->unfinished > 0;
+    }
+
+    static size_t configured = 0;
+
+    void set_parallelism(size_t threads) {
+        configured = threads;
+    }
+
+    size_t parallelism() {
+        if (configured > 0) return configured;
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    /* builtins */
+    static FutureObject* __future_checking(const Value& value) {
+        if (!value.is(ObjectKind::Future))
+            throw SyntaxError(ErrorCode::Parallel, "[parallel error] Data type of operand is not Future.");
+        return (FutureObject*)value.as_object();
+    }
+
+    // the futures of a pmap or pcall are pinned until their results are in the result list;
+    // collections stay paused while they are submitted, so none is collected before its pin
+    struct Batch {
+        std::vector<FutureObject*> futures;
+        bool paused = true;
+        Batch() { heap().pause_collections(); }
+        ~Batch() {
+            if (this->paused) heap().resume_collections();
+            for (FutureObject* future : this->futures) heap().unpin(Value(future));
+        }
+        void add(FutureObject* future) {
+            heap().pin(Value(future));
+            this->futures.push_back(future);
+        }
+        void submitted() {
+            heap().resume_collections();
+            this->paused = false;
+        }
+    };
+
+    // waits in order; the first error is thrown again once every earlier result is in
+    static std::vector<Value> __results(Batch& batch) {
+        Evaluator& evaluator = *Evaluator::current();
+        std::vector<Value> results;
+        for (FutureObject* future : batch.futures)
+            results.push_back(evaluator.pool().wait(future, evaluator));
+        return results;
+    }
+
+    Value __future__(const Value* argv, size_t /*argc*/) {
+        return Value(Evaluator::current()->pool().submit(argv[0], {}));
+    }
+
+    // runs queued tasks while it waits; `argv` is not read after that, since it may have moved
+    Value __deref__(const Value* argv, size_t /*argc*/) {
+        FutureObject* future = __future_checking(argv[0]);
+        Evaluator& evaluator = *Evaluator::current();
+        return evaluator.pool().wait(future, evaluator);
+    }
+
+    Value __pmap__(const Value* argv, size_t /*argc*/) {
+        Value callee = argv[0];
+        bool vector = argv[1].is(ObjectKind::PersistentVector);
+        std::vector<Value> items;
+        if (vector) {
+            auto source = (PersistentVectorObject*)argv[1].as_object();
+            for (size_t i = 0; i < source->count; i++) items.push_back(source->get(i));
+        } else if (argv[1].is(ObjectKind::Cons) || argv[1].type() == ValueType::Null) {
+            for (Value cell = argv[1]; cell.is(ObjectKind::Cons); cell = ((ConsObject*)cell.as_object())->tail)
+                items.push_back(((ConsObject*)cell.as_object())->head);
+        } else {
+            throw SyntaxError(ErrorCode::Collection, "[collection error] Data type of operand is not List or Vector.");
+        }
+
+        ThreadPool& pool = Evaluator::current()->pool();
+        Batch batch;
+        for (const Value& item : items) batch.add(pool.submit(callee, {item}));
+        batch.submitted();
+        std::vector<Value> results = __results(batch);
+        return vector ? make_vector(results.data(), results.size()) : make_list(results.data(), results.size());
+    }
+
+    Value __pcall__(const Value* argv, size_t argc) {
+        ThreadPool& pool = Evaluator::current()->pool();
+        Batch batch;
+        for (size_t i = 0; i < argc; i++) batch.add(pool.submit(argv[i], {}));
+        batch.submitted();
+        std::vector<Value> results = __results(batch);
+        return make_list(results.data(), results.size());
+    }
+
+    void define_parallel_natives(Environment& globals) {
+        static const struct {
+            const char* name;
+            int arity;
+            NativeFunction function;
+        } natives[] = {
+            {"future", 1, __future__},
+            {"deref", 1, __deref__},
+            {"pmap", 2, __pmap__},
+            {"pcall", -1, __pcall__},
+        };
+        for (const auto& native : natives)
+            globals.add(intern(native.name), Value(heap().make<NativeObject>(native.name, native.arity, native.function)));
+    }
+
+} // namespace lisp
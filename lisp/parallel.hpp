@@ -0,0 +1,92 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include "environment.hpp"
+#include "error.hpp"
+#include "value.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lisp {
+
+    class Evaluator;
+
+    // a call which runs on a ThreadPool; `deref` waits for its result.
+    class FutureObject : public Object {
+    public:
+        Value callee;
+        std::vector<Value> arguments;
+        Value result;
+        std::exception_ptr error;   // thrown again by every wait
+        Environment* globals = nullptr;     // of the evaluator which submitted it
+        std::atomic<bool> done{false};
+        FutureObject(Value callee, std::vector<Value> arguments);
+        void trace(Heap& heap) const override;
+        size_t footprint() const override;
+        const char* type_name() const override;
+        void print(std::ostream& out) const override;
+    };
+
+    // work-stealing pool of `threads - 1` worker threads, each with its own Evaluator
+    // which reads the globals of the root one. a worker runs its own tasks newest first
+    // and steals the oldest task of another queue when it has none; a thread waiting for
+    // a future runs queued tasks meanwhile. with one thread a task runs when it is
+    // submitted. collections are paused while a submitted task is not done.
+    class ThreadPool {
+    private:
+        struct Worker {
+            std::mutex lock;
+            std::deque<FutureObject*> tasks;
+            std::unique_ptr<Evaluator> evaluator;
+            std::thread thread;
+        };
+        std::vector<std::unique_ptr<Worker>> workers;
+        Heap* owner;            // heap of the root evaluator, used by the workers too
+        std::mutex lock;
+        std::deque<FutureObject*> injected;     // tasks submitted by other threads
+        std::condition_variable wake;           // a task was queued, or stopping
+        std::condition_variable finished;       // a task is done
+        std::atomic<size_t> queued{0};
+        std::atomic<size_t> unfinished{0};
+        bool stopping = false;
+
+        FutureObject* take(int self);
+        bool run_one(Evaluator& evaluator, int self);
+        void execute(FutureObject* task, Evaluator& evaluator);
+        void work(int self);
+    public:
+        ThreadPool(Evaluator& root, size_t threads);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        // the caller keeps the future reachable once it is done
+        FutureObject* submit(Value callee, std::vector<Value> arguments);
+        Value wait(FutureObject* future, Evaluator& evaluator);
+        // runs queued tasks until every submitted one is done; not from a task
+        void finish(Evaluator& evaluator);
+        // some submitted task is not done; only a thread outside the tasks may rely on `false`
+        bool busy() const;
+        size_t size() const;
+    };
+
+    // whether the calling thread is running a task, maybe while it waits for another one
+    bool in_parallel_task();
+
+    // threads of the pools started from now on; 0 is the number of hardware threads
+    void set_parallelism(size_t threads);
+    size_t parallelism();
+
+    // defines future, deref, pmap and pcall as NativeObjects in `globals`.
+    void define_parallel_natives(Environment& globals);
+
+} // namespace lisp
+
+#endif
@@ -1,202 +1,212 @@
 #include "parser.hpp"
 
+#include <climits>
+
 namespace lisp {
 
     /* Parser */
-    Parser::NodeType Parser::node_type_finder(std::string str) {
+    Parser::NodeType Parser::node_type_finder(std::string_view str) {
         assert(str.length() > 0);
         if (str[0] == '\'' || str[0] == '"') return NodeType::Literal;
         if ('0' <= str[0] && str[0] <= '9') return NodeType::Literal;
-        if ((str[0] == '+' || str[0] == '-') && '0' <= str[1] && str[1] <= '9') return NodeType::Literal;
+        if ((str[0] == '+' || str[0] == '-') && str.length() > 1 && '0' <= str[1] && str[1] <= '9') return NodeType::Literal;
         if (str == "false" || str == "true" || str == "null") return NodeType::Literal;
         return NodeType::Symbol;
     }
 
-    Parser::LiteralType Parser::literal_type_finder(std::string str) {
-        if (str == "false" || str == "true") return LiteralType::Bool;
-        if (str == "null") return LiteralType::Null;
-        if (str[0] == '\'') {
-            if (str.length() == 3 && str[2] == '\'') return LiteralType::Char;
-            throw SyntaxError((char*)"[token error] Given code does not match to required character format.");
-        }
-        if (str[0] == '"') {
-            if (str.back() == '"') return LiteralType::String;
-            throw SyntaxError((char*)"[token error] Given code does not match to required string format.");
-        }
-        if (str[0] == '-' || str[0] == '+') str.erase(str.begin());
-        for (char c : str) {
-            if (c < '0' || c > '9') {
-                throw SyntaxError((char*)"[token error] Given code does not match to required integer format.");
+    bool Parser::literal_type_finder(std::string_view str, LiteralType& type) {
+        if (str == "false" || str == "true") {
+            type = LiteralType::Bool;
+        } else if (str == "null") {
+            type = LiteralType::Null;
+        } else if (str[0] == '\'') {
+            if (str.length() != 3 || str[2] != '\'') {
+                set_pending_error(ErrorCode::Token, "[token error] Given code does not match to required character format.");
+                return false;
+            }
+            type = LiteralType::Char;
+        } else if (str[0] == '"') {
+            if (str.back() != '"') {
+                set_pending_error(ErrorCode::Token, "[token error] Given code does not match to required string format.");
+                return false;
+            }
+            type = LiteralType::String;
+        } else {
+            // a literal out of the range of Int is no more an integer than one with a letter
+            long long limit = str[0] == '-' ? -(long long)INT_MIN : INT_MAX;
+            long long value = 0;
+            if (str[0] == '-' || str[0] == '+') str.remove_prefix(1);
+            for (char c : str) {
+                if (c < '0' || c > '9' || (value = value * 10 + (c - '0')) > limit) {
+                    set_pending_error(ErrorCode::Token, "[token error] Given code does not match to required integer format.");
+                    return false;
+                }
             }
+            type = LiteralType::Int;
         }
-        return LiteralType::Int;
+        return true;
     }
 
-    int Parser::text_to_int(std::string text) {
-        int ret = 0, sgn = 1;
+    // `text` passed literal_type_finder, so it fits in Int
+    int Parser::text_to_int(std::string_view text) {
+        long long ret = 0, sgn = 1;
         if (text[0] == '-') sgn = -1;
-        if (text[0] == '-' || text[0] == '+') text.erase(text.begin());
+        if (text[0] == '-' || text[0] == '+') text.remove_prefix(1);
         for (char c : text) {
             ret = ret * 10 + (c - '0');
         }
-        return sgn * ret;
+        return (int)(sgn * ret);
     }
 
-    char Parser::text_to_char(std::string text) {
+    char Parser::text_to_char(std::string_view text) {
         return text[1];
     }
 
-    std::string Parser::text_to_string(std::string text) {
-        text.erase(text.begin());
-        text.pop_back();
-        return text;
+    std::string Parser::text_to_string(std::string_view text) {
+        return std::string(text.substr(1, text.length() - 2));
     }
 
-    bool Parser::text_to_bool(std::string text) {
+    bool Parser::text_to_bool(std::string_view text) {
         return text == "true";
     }
 
-    std::nullptr_t Parser::text_to_null(std::string text) {
+    std::nullptr_t Parser::text_to_null(std::string_view) {
         return nullptr;
     }
 
-    ASTNode* Parser::token_to_node(std::string token) {
-        NodeType node_type = node_type_finder(token);
-        if (node_type == NodeType::Symbol) {
-            return new SymbolNode(token);
-        } else if (node_type == NodeType::Literal) {
-            LiteralType literal_type = literal_type_finder(token);
-            if (literal_type == LiteralType::Int)
-                return new LiteralNode(text_to_int(token));
-            else if (literal_type == LiteralType::Char)
-                return new LiteralNode(text_to_char(token));
-            else if (literal_type == LiteralType::String)
-                return new LiteralNode(text_to_string(token));
-            else if (literal_type == LiteralType::Bool)
-                return new LiteralNode(text_to_bool(token));
-            else if (literal_type == LiteralType::Null)
-                return new LiteralNode(text_to_null(token));
+    ASTNode* Parser::token_to_node(const Token& token) {
+        if (token.kind == TokenKind::Invalid) {
+            set_pending_error(ErrorCode::Token, "[token error] Given token does not match to required format.", token.position);
+            return nullptr;
+        }
+        std::string_view text = token.text;
+        ASTNode* node = nullptr;
+        LiteralType literal_type;
+        if (node_type_finder(text) == NodeType::Symbol) {
+            node = arena->make<SymbolNode>(text);
+        } else if (!literal_type_finder(text, literal_type)) {
+            locate_pending_error(token.position);
+            return nullptr;
+        } else if (literal_type == LiteralType::Int) {
+            node = arena->make<LiteralNode>(text_to_int(text));
+        } else if (literal_type == LiteralType::Char) {
+            node = arena->make<LiteralNode>(text_to_char(text));
+        } else if (literal_type == LiteralType::String) {
+            node = arena->make<LiteralNode>(text_to_string(text));
+        } else if (literal_type == LiteralType::Bool) {
+            node = arena->make<LiteralNode>(text_to_bool(text));
+        } else {
+            node = arena->make<LiteralNode>(text_to_null(text));
+        }
+        node->position = token.position;
+        return node;
+    }
+
+    // a malformed fn* stays a ListNode; the evaluator reports it when it is reached.
+    ASTNode* Parser::make_list(std::vector<ASTNode*> childs, SourcePosition position) {
+        ASTNode* node = nullptr;
+        if (childs.size() != 3 || childs[0]->kind != NodeKind::Symbol || ((SymbolNode*)childs[0])->symbol_id != SYM_FN
+            || childs[1]->kind != NodeKind::List) {
+            node = arena->make<ListNode>(std::move(childs));
+            node->position = position;
+            return node;
+        }
+        std::vector<SymbolId> parameters;
+        for (ASTNode* parameter : ((ListNode*)childs[1])->sub_nodes) {
+            if (parameter->kind != NodeKind::Symbol) {
+                node = arena->make<ListNode>(std::move(childs));
+                node->position = position;
+                return node;
+            }
+            parameters.push_back(((SymbolNode*)parameter)->symbol_id);
         }
-        throw SyntaxError((char*)"[token error] Given token does not match to required format.");
+        FunctionNode* function = arena->make<FunctionNode>(std::move(parameters), childs[2]);
+        function->position = position;
+        this->functions.push_back(function);
+        return function;
     }
 
-    ListNode* Parser::parse_list(std::queue<std::string>& token_queue) {
+    // `position` is the one of the opening parenthesis
+    ASTNode* Parser::parse_list(Lexer& lexer, SourcePosition position) {
         std::vector<ASTNode*> childs;
-        while (!token_queue.empty()) {
-            std::string token = token_queue.front();
-            token_queue.pop();
-            if (token == ")") {
-                return new ListNode(childs);
-            } else if (token == "(") {
-                childs.push_back(this->parse_list(token_queue));
+        while (true) {
+            Token token = lexer.next();
+            if (token.kind == TokenKind::End) break;
+            ASTNode* child;
+            if (token.kind == TokenKind::RightParen) {
+                return this->make_list(std::move(childs), position);
+            } else if (token.kind == TokenKind::LeftParen) {
+                child = this->parse_list(lexer, token.position);
             } else {
-                childs.push_back(token_to_node(token));
+                child = this->token_to_node(token);
             }
+            if (child == nullptr) return nullptr;
+            childs.push_back(child);
         }
-        throw SyntaxError((char*)"[parentheses error] Parentheses are not well-matched.");
+        set_pending_error(ErrorCode::Parentheses, "[parentheses error] Parentheses are not well-matched.", position);
+        return nullptr;
     }
 
-    Parser::Parser(std::vector<std::string> token_list) {
-        std::queue<std::string> token_queue;
-        for (std::string token : token_list) {
-            token_queue.push(token);
-        }
+    Parser::Parser(std::string_view source, SourcePosition start) {
+        Lexer lexer(source, start);
 
         /* general case
-        while (!token_queue.empty()) {
-            std::string token = token_queue.front();
-            token_queue.pop();
-            if (token == ")") {
-                throw SyntaxError((char*)"[parentheses error] Parentheses are not well-matched.");
-            } else if (token == "(") {
-                root->sub_nodes.push_back(this->parse_list(token_queue));
+        for (Token token = lexer.next(); token.kind != TokenKind::End; token = lexer.next()) {
+            if (token.kind == TokenKind::RightParen) {
+                throw SyntaxError(ErrorCode::Parentheses, "[parentheses error] Parentheses are not well-matched.");
+            } else if (token.kind == TokenKind::LeftParen) {
+                root->sub_nodes.push_back(this->parse_list(lexer));
             } else {
-                root->sub_nodes.push_back(token_to_node(token));
+                root->sub_nodes.push_back(token_to_node(token.text));
             }
         } */
 
-        if (token_queue.front() != "(")
-            throw SyntaxError((char*)"[parentheses error] Code must start with an opening parenthesis.");
-        
-        token_queue.pop();
-        ((ListNode*)root)->sub_nodes.push_back(this->parse_list(token_queue));
-        
-        if (!token_queue.empty())
-            throw SyntaxError((char*)"[parentheses error] Parentheses are not well-matched.");
+        // an invalid token is reported before anything else about it
+        Token first = lexer.next();
+        if (first.kind == TokenKind::Invalid && this->token_to_node(first) == nullptr) throw_pending_error();
+        if (first.kind != TokenKind::LeftParen)
+            throw SyntaxError(ErrorCode::Parentheses, "[parentheses error] Code must start with an opening parenthesis.", first.position);
+        root->position = first.position;
+
+        ASTNode* form = this->parse_list(lexer, first.position);
+        if (form == nullptr) throw_pending_error();
+        ((ListNode*)root)->sub_nodes.push_back(form);
+
+        Token rest = lexer.next();
+        if (rest.kind == TokenKind::Invalid && this->token_to_node(rest) == nullptr) throw_pending_error();
+        if (rest.kind != TokenKind::End)
+            throw SyntaxError(ErrorCode::Parentheses, "[parentheses error] Parentheses are not well-matched.", rest.position);
     }
 
-    void Parser::print_node(ASTNode* node, int depth) {
-        for (int i = 0; i < depth; i++) std::cout << "    ";
-        node->print();
-        if (node->type == "List") {
+    void Parser::print_node(ASTNode* node, int depth, std::ostream& out) {
+        for (int i = 0; i < depth; i++) out << "    ";
+        node->print(out);
+        if (node->kind == NodeKind::List) {
             for (ASTNode* sub_node : ((ListNode*)node)->sub_nodes) {
-                print_node(sub_node, depth + 1);
+                print_node(sub_node, depth + 1, out);
             }
+        } else if (node->kind == NodeKind::Function) {
+            print_node(((FunctionNode*)node)->body, depth + 1, out);
         }
     }
 
-    void Parser::print() {
-        print_node(root, 0);
+    void Parser::print(std::ostream& out) {
+        print_node(root, 0, out);
     }
 
-    std::vector<std::string> tokenize(std::string str) {
+    std::vector<std::string> tokenize(std::string_view str) {
         std::vector<std::string> token_list;
-        std::string::iterator start;
-        start = str.begin();
-        while (start != str.end()) {
-            if (start != str.end() && *start == ' ') {
-                start++;
-                continue;
-            }
-            if (start != str.end() && *start == '"') {
-                token_list.push_back(std::string(1, '"'));
-                start++;
-                while (start != str.end() && *start != '"') {
-                    token_list.back().push_back(*start);
-                    start++;
-                }
-                if (start == str.end()) 
-                    throw SyntaxError((char*)"[token error] Given token does not match to required format.");
-                token_list.back().push_back(*start);
-                start++;
-                continue;
-            }
-            if (start != str.end() && *start == '\'') {
-                token_list.push_back(std::string(1, '\''));
-                start++;
-                while (start != str.end() && *start != '\'') {
-                    token_list.back().push_back(*start);
-                    start++;
-                }
-                if (start == str.end()) 
-                    throw SyntaxError((char*)"[token error] Given token does not match to required format.");
-                token_list.back().push_back(*start);
-                start++;
-                if (token_list.back().length() != 3) 
-                    throw SyntaxError((char*)"[token error] Given token does not match to required format.");
-                continue;
-            }
-            if (start != str.end() && (*start == '(' || *start == ')')) {
-                token_list.push_back(std::string(1, *start));
-                start++;
-                continue;
-            }
-            std::string::iterator iter = start;
-            token_list.push_back(std::string());
-            while (iter != str.end() && *iter != ' ' && *iter != '(' && *iter != ')' && *iter != '\'' && *iter != '"') {
-                token_list.back().push_back(*iter);
-                iter++;
-            }
-            if (token_list.back().length() == 0) token_list.pop_back();
-            start = iter;
+        Lexer lexer(str);
+        for (Token token = lexer.next(); token.kind != TokenKind::End; token = lexer.next()) {
+            if (token.kind == TokenKind::Invalid)
+                throw SyntaxError(ErrorCode::Token, "[token error] Given token does not match to required format.", token.position);
+            token_list.push_back(std::string(token.text));
         }
-
         return token_list;
     }
 
-    Parser read_str(std::string str) {
-        std::vector<std::string> token_list = tokenize(str);
-        return Parser(token_list);
+    Parser read_str(std::string_view str, SourcePosition start) {
+        return Parser(str, start);
     }
 
 } // namespace lisp
\ No newline at end of file
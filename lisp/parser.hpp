@@ -1,13 +1,16 @@
 #ifndef PARSER_HPP
 #define PARSER_HPP
 
+#include "arena.hpp"
 #include "astnode.hpp"
 #include "error.hpp"
+#include "lexer.hpp"
 #include <iostream>
+#include <memory>
 #include <cassert>
 #include <vector>
-#include <queue>
 #include <string>
+#include <string_view>
 
 namespace lisp {
 
@@ -16,25 +19,31 @@ namespace lisp {
         enum class NodeType { Literal, Symbol, Function };
         enum class LiteralType { Int, Char, String, Bool, Null };
 
-        NodeType node_type_finder(std::string str);
-        LiteralType literal_type_finder(std::string str);
-        int text_to_int(std::string text);
-        char text_to_char(std::string text);
-        std::string text_to_string(std::string text);
-        bool text_to_bool(std::string text);
-        std::nullptr_t text_to_null(std::string text);
-        ASTNode* token_to_node(std::string token);
-        ListNode* parse_list(std::queue<std::string>& token_queue);
-        void print_node(ASTNode* node, int depth);
+        // these return false or nullptr with the error pending; see pending_error()
+        NodeType node_type_finder(std::string_view str);
+        bool literal_type_finder(std::string_view str, LiteralType& type);
+        int text_to_int(std::string_view text);
+        char text_to_char(std::string_view text);
+        std::string text_to_string(std::string_view text);
+        bool text_to_bool(std::string_view text);
+        std::nullptr_t text_to_null(std::string_view text);
+        ASTNode* token_to_node(const Token& token);
+        ASTNode* parse_list(Lexer& lexer, SourcePosition position);
+        ASTNode* make_list(std::vector<ASTNode*> childs, SourcePosition position);
+        void print_node(ASTNode* node, int depth, std::ostream& out);
 
     public:
-        ASTNode* root = new ListNode({});
-        Parser(std::vector<std::string> token_list);
-        void print();
+        std::unique_ptr<Arena> arena = std::make_unique<Arena>();
+        ASTNode* root = arena->make<ListNode>(std::vector<ASTNode*>());
+        // every fn* of the form; closures keep pointers into the arena, see Evaluator::retain
+        std::vector<FunctionNode*> functions;
+        // `start` is the position of the source in its file; a SyntaxError gives its own
+        Parser(std::string_view source, SourcePosition start = SourcePosition{1, 1});
+        void print(std::ostream& out);
     };
 
-    std::vector<std::string> tokenize(std::string str);
-    Parser read_str(std::string str);
+    std::vector<std::string> tokenize(std::string_view str);
+    Parser read_str(std::string_view str, SourcePosition start = SourcePosition{1, 1});
 
 } // namespace lisp
 
@@ -0,0 +1,225 @@
+#include "profiler.hpp"
+
+#include "heap.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LISP_HAS_SIGPROF 1
+#include <csignal>
+#include <pthread.h>
+#include <sys/time.h>
+#endif
+
+namespace lisp {
+
+    static const std::uint32_t DEEPER = 0;
+
+    /* Profiler */
+    Profiler::Profiler(unsigned interval_us, size_t buffer_words)
+        : buffer(new std::uint32_t[buffer_words]), capacity(buffer_words), interval_us(interval_us) {
+        this->label("[deeper]");
+        this->label("symbol lookup");
+        for (SymbolId oper = 0; oper < SYM_BUILTIN_COUNT; oper++)
+            this->label(symbol_name(oper));
+    }
+
+    Profiler::~Profiler() {
+        this->stop();
+    }
+
+    std::uint32_t Profiler::label(std::string name) {
+        // ; separates frames and a newline ends a stack in the folded format
+        std::replace(name.begin(), name.end(), ';', ',');
+        std::replace(name.begin(), name.end(), '\n', ' ');
+        std::replace(name.begin(), name.end(), '\r', ' ');
+        this->names.push_back(std::move(name));
+        this->named.push_back(false);
+        this->calls.push_back(0);
+        return (std::uint32_t)this->names.size() - 1;
+    }
+
+    // a function made outside of a form, e.g. by a loaded image
+    std::uint32_t Profiler::new_function_label(FunctionNode* function) {
+        function->profile_label = this->label("fn*");
+        return function->profile_label;
+    }
+
+    std::uint32_t Profiler::new_native_label(NativeObject* native) {
+        native->profile_label = this->label(native->name);
+        return native->profile_label;
+    }
+
+    void Profiler::name_function(FunctionNode* function, SymbolId name) {
+        std::uint32_t label = this->function_label(function);
+        if (this->named[label]) return;
+        this->names[label] = symbol_name(name);
+        this->named[label] = true;
+    }
+
+    void Profiler::begin_form(std::string_view code, const std::vector<FunctionNode*>& functions) {
+        size_t index = this->forms.size() + 1;
+        std::string text(code.substr(0, 48));
+        std::replace(text.begin(), text.end(), '\t', ' ');
+        if (code.size() > 48) text += "...";
+        std::uint32_t label = this->label("form " + std::to_string(index) + ": " + text);
+        for (FunctionNode* function : functions)
+            if (function->profile_label == 0)
+                function->profile_label = this->label("fn* of form " + std::to_string(index));
+
+        this->reset(0);
+        this->push(label);
+        this->forms.push_back({label, 0, 0, 0});
+        GcStats stats = heap().stats();
+        this->form_objects = stats.allocated_objects;
+        this->form_bytes = stats.allocated_bytes;
+        this->form_start = std::chrono::steady_clock::now();
+    }
+
+    void Profiler::end_form() {
+        Form& form = this->forms.back();
+        form.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - this->form_start).count();
+        GcStats stats = heap().stats();
+        form.objects = stats.allocated_objects - this->form_objects;
+        form.bytes = stats.allocated_bytes - this->form_bytes;
+        this->reset(0);
+        this->drain();
+    }
+
+    // runs on the profiled thread with SIGPROF blocked, so the buffer is not written meanwhile
+    void Profiler::drain() {
+#ifdef LISP_HAS_SIGPROF
+        sigset_t block, old;
+        sigemptyset(&block);
+        sigaddset(&block, SIGPROF);
+        pthread_sigmask(SIG_BLOCK, &block, &old);
+#endif
+        size_t used = this->used.load(std::memory_order_relaxed);
+        for (size_t pos = 0; pos < used;) {
+            size_t count = this->buffer[pos++];
+            this->folded[std::vector<std::uint32_t>(&this->buffer[pos], &this->buffer[pos] + count)]++;
+            this->samples++;
+            pos += count;
+        }
+        this->used.store(0, std::memory_order_relaxed);
+#ifdef LISP_HAS_SIGPROF
+        pthread_sigmask(SIG_SETMASK, &old, nullptr);
+#endif
+    }
+
+    void Profiler::sample() {
+        size_t depth = this->depth.load(std::memory_order_relaxed);
+        std::atomic_signal_fence(std::memory_order_acquire);
+        if (depth == 0) return;
+        size_t kept = std::min(depth, MAX_DEPTH);
+        size_t count = kept + (depth > MAX_DEPTH);
+        size_t used = this->used.load(std::memory_order_relaxed);
+        if (used + 1 + count > this->capacity) {
+            this->dropped++;
+            return;
+        }
+        this->buffer[used] = (std::uint32_t)count;
+        std::copy(this->stack, this->stack + kept, &this->buffer[used + 1]);
+        if (depth > MAX_DEPTH) this->buffer[used + 1 + kept] = DEEPER;
+        this->used.store(used + 1 + count, std::memory_order_relaxed);
+    }
+
+#ifdef LISP_HAS_SIGPROF
+    // SIGPROF goes to whichever thread is running; only the one which started the
+    // profiler has a shadow stack
+    static std::atomic<Profiler*> sampled{nullptr};
+    static thread_local bool profiled_thread = false;
+    static struct sigaction previous;
+
+    static void __on_sigprof(int) {
+        Profiler* profiler = sampled.load(std::memory_order_relaxed);
+        if (profiler == nullptr) return;
+        if (profiled_thread) profiler->sample();
+        else profiler->sample_elsewhere();
+    }
+#endif
+
+    void Profiler::start() {
+#ifdef LISP_HAS_SIGPROF
+        if (this->sampling) return;
+        profiled_thread = true;
+        sampled.store(this, std::memory_order_relaxed);
+        struct sigaction action = {};
+        action.sa_handler = __on_sigprof;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, &previous);
+        struct itimerval timer = {};
+        timer.it_interval.tv_sec = this->interval_us / 1000000;
+        timer.it_interval.tv_usec = this->interval_us % 1000000;
+        timer.it_value = timer.it_interval;
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        this->sampling = true;
+#endif
+    }
+
+    void Profiler::stop() {
+#ifdef LISP_HAS_SIGPROF
+        if (!this->sampling) return;
+        struct itimerval timer = {};
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        sigaction(SIGPROF, &previous, nullptr);
+        sampled.store(nullptr, std::memory_order_relaxed);
+        profiled_thread = false;
+        this->sampling = false;
+        this->drain();
+#endif
+    }
+
+    void Profiler::print(std::ostream& out) {
+        this->drain();
+        std::vector<size_t> self(this->names.size()), total(this->names.size());
+        for (auto& stack : this->folded) {
+            self[stack.first.back()] += stack.second;
+            std::vector<std::uint32_t> seen(stack.first);
+            std::sort(seen.begin(), seen.end());
+            seen.erase(std::unique(seen.begin(), seen.end()), seen.end());
+            for (std::uint32_t label : seen) total[label] += stack.second;
+        }
+        auto percent = [&](size_t count) {
+            return this->samples == 0 ? 0.0 : 100.0 * count / this->samples;
+        };
+
+        out << "{Profile} samples: " << this->samples << " (" << this->interval_us << " us interval)"
+            << ", other threads: " << this->elsewhere << ", dropped: " << this->dropped << "\n";
+        std::vector<const Form*> forms;
+        for (const Form& form : this->forms) forms.push_back(&form);
+        std::stable_sort(forms.begin(), forms.end(), [](const Form* a, const Form* b) { return a->ms > b->ms; });
+        out << std::fixed << std::setprecision(3);
+        for (const Form* form : forms)
+            out << "{Profile} " << this->names[form->label] << ": " << form->ms << " ms, "
+                << form->objects << " objects / " << form->bytes << " bytes\n";
+
+        // forms are listed above; operators, functions and natives follow
+        std::vector<std::uint32_t> labels;
+        for (std::uint32_t label = 0; label < this->names.size(); label++)
+            if (this->calls[label] > 0 || total[label] > 0) labels.push_back(label);
+        for (const Form& form : this->forms)
+            labels.erase(std::remove(labels.begin(), labels.end(), form.label), labels.end());
+        std::stable_sort(labels.begin(), labels.end(), [&](std::uint32_t a, std::uint32_t b) {
+            if (self[a] != self[b]) return self[a] > self[b];
+            return this->calls[a] > this->calls[b];
+        });
+        out << std::setprecision(1);
+        for (std::uint32_t label : labels)
+            out << "{Profile} " << this->names[label] << ": " << this->calls[label] << " calls, "
+                << percent(self[label]) << "% self, " << percent(total[label]) << "% total\n";
+        out << std::defaultfloat << std::setprecision(6);
+    }
+
+    void Profiler::print_folded(std::ostream& out) {
+        this->drain();
+        for (auto& stack : this->folded) {
+            for (size_t i = 0; i < stack.first.size(); i++)
+                out << (i > 0 ? ";" : "") << this->names[stack.first[i]];
+            out << " " << stack.second << "\n";
+        }
+    }
+
+} // namespace lisp
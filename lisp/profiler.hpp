@@ -0,0 +1,117 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include "astnode.hpp"
+#include "symbol.hpp"
+#include "value.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lisp {
+
+    // sampling profiler of the thread which runs the forms. the Evaluator keeps a shadow
+    // stack of labels -- the form, the functions it is in and the operator it evaluates
+    // -- and counts every push as a call. a SIGPROF timer copies the stack into a buffer,
+    // which is folded into stack counts between forms. where there is no SIGPROF, only
+    // the counts and the per-form time are kept.
+    class Profiler {
+    public:
+        static constexpr std::uint32_t LOOKUP = 1;     // global symbol lookup
+        static constexpr size_t MAX_DEPTH = 1024;      // deeper frames are counted but not sampled
+
+    private:
+        std::uint32_t stack[MAX_DEPTH];
+        std::atomic<size_t> depth{0};
+        std::vector<std::uint64_t> calls;           // by label
+        std::vector<std::string> names;             // by label
+        std::vector<bool> named;                    // a function label got its def! name
+
+        // samples: depth, then the labels from the root
+        std::unique_ptr<std::uint32_t[]> buffer;
+        size_t capacity;
+        std::atomic<size_t> used{0};
+        std::atomic<size_t> dropped{0};
+        std::atomic<size_t> elsewhere{0};           // samples which hit other threads
+        std::map<std::vector<std::uint32_t>, size_t> folded;
+        size_t samples = 0;
+        unsigned interval_us;
+        bool sampling = false;
+
+        struct Form {
+            std::uint32_t label;
+            double ms;
+            size_t objects;
+            size_t bytes;
+        };
+        std::vector<Form> forms;
+        std::chrono::steady_clock::time_point form_start;
+        size_t form_objects = 0;
+        size_t form_bytes = 0;
+
+        std::uint32_t label(std::string name);
+        std::uint32_t new_function_label(FunctionNode* function);
+        std::uint32_t new_native_label(NativeObject* native);
+        void drain();
+
+    public:
+        Profiler(unsigned interval_us = 1000, size_t buffer_words = 1 << 22);
+        ~Profiler();
+        Profiler(const Profiler&) = delete;
+        Profiler& operator=(const Profiler&) = delete;
+
+        // the signal fences keep each store in order for the SIGPROF handler of this thread
+        void push(std::uint32_t label) { this->put(this->depth.load(std::memory_order_relaxed), label); }
+        // push() onto a stack cut to `top` labels, which the caller already knows
+        void put(size_t top, std::uint32_t label) {
+            if (top < MAX_DEPTH) this->stack[top] = label;
+            std::atomic_signal_fence(std::memory_order_release);
+            this->depth.store(top + 1, std::memory_order_relaxed);
+            this->calls[label]++;
+        }
+        size_t mark() const { return this->depth.load(std::memory_order_relaxed); }
+        void reset(size_t mark) { this->depth.store(mark, std::memory_order_relaxed); }
+
+        static std::uint32_t operator_label(SymbolId oper) { return 2 + oper; }
+        std::uint32_t function_label(FunctionNode* function) {
+            return function->profile_label != 0 ? function->profile_label : this->new_function_label(function);
+        }
+        std::uint32_t native_label(NativeObject* native) {
+            return native->profile_label != 0 ? native->profile_label : this->new_native_label(native);
+        }
+        // inline, since the Evaluator calls these on every operator and call while profiling
+        void enter_operator(size_t floor, SymbolId oper) { this->put(floor, operator_label(oper)); }
+        void enter_function(size_t floor, FunctionNode* function) { this->put(floor, this->function_label(function)); }
+        void enter_native(NativeObject* native) { this->push(this->native_label(native)); }
+        // the first def! of a closure names its function
+        void name_function(FunctionNode* function, SymbolId name);
+
+        // a form of the script; its functions are labelled after it until def! names them
+        void begin_form(std::string_view code, const std::vector<FunctionNode*>& functions);
+        void end_form();
+
+        // the SIGPROF handler and timer of the calling thread
+        void start();
+        void stop();
+
+        // forms by time, then labels by samples and calls
+        void print(std::ostream& out);
+        // one "root;...;leaf count" line per stack, for flamegraph.pl and similar tools
+        void print_folded(std::ostream& out);
+
+        // called by the SIGPROF handler
+        void sample();
+        void sample_elsewhere() { this->elsewhere++; }
+    };
+
+} // namespace lisp
+
+#endif
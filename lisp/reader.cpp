@@ -0,0 +1,100 @@
+#include "reader.hpp"
+#include "error.hpp"
+#include "lexer.hpp"
+
+namespace lisp {
+
+    /* Reader */
+    Reader::Reader(std::istream& input, size_t chunk_size) : input(&input), chunk_size(chunk_size) {}
+
+    Reader::Reader(std::string_view source) : text(source) {}
+
+    void Reader::advance(char c) {
+        this->pos++;
+        if (c == '\n') {
+            this->now.line++;
+            this->now.column = 1;
+        } else {
+            this->now.column++;
+        }
+    }
+
+    bool Reader::fill() {
+        if (this->input == nullptr) return false;
+
+        // drop everything before the current form
+        size_t keep = this->started ? this->begin : this->pos;
+        this->buffer.erase(0, keep);
+        this->begin -= this->started ? keep : 0;
+        this->pos -= keep;
+
+        if (!*this->input) return false;
+        size_t size = this->buffer.size();
+        this->buffer.resize(size + this->chunk_size);
+        this->input->read(&this->buffer[size], this->chunk_size);
+        this->buffer.resize(size + this->input->gcount());
+        this->text = this->buffer;
+        return this->buffer.size() > size;
+    }
+
+    bool Reader::yield(std::string_view& form) {
+        form = this->text.substr(this->begin, this->pos - this->begin);
+        return true;
+    }
+
+    // the returned form is valid until the next call.
+    bool Reader::next(std::string_view& form) {
+        this->started = false;
+        int depth = 0;
+        char quote = 0;
+        while (true) {
+            if (this->pos == this->text.size()) {
+                if (!this->fill()) break;
+                continue;
+            }
+            char c = this->text[this->pos];
+            if (!this->started) {
+                if (is_space(c)) {
+                    this->advance(c);
+                    continue;
+                }
+                this->started = true;
+                this->begin = this->pos;
+                this->start = this->now;
+            }
+            // at depth 0 anything but a list is an atom, which ends at a delimiter
+            bool in_atom = depth == 0 && this->pos != this->begin;
+            if (quote != 0) {
+                this->advance(c);
+                if (c == quote) {
+                    quote = 0;
+                    if (depth == 0) return this->yield(form);
+                }
+            } else if (c == '"' || c == '\'') {
+                if (in_atom) return this->yield(form);
+                quote = c;
+                this->advance(c);
+            } else if (c == '(') {
+                if (in_atom) return this->yield(form);
+                depth++;
+                this->advance(c);
+            } else if (c == ')') {
+                if (in_atom) return this->yield(form);
+                if (depth == 0)
+                    throw SyntaxError(ErrorCode::Parentheses, "[parentheses error] Parentheses are not well-matched.", this->now);
+                depth--;
+                this->advance(c);
+                if (depth == 0) return this->yield(form);
+            } else if (is_space(c) && depth == 0) {
+                return this->yield(form);
+            } else {
+                this->advance(c);
+            }
+        }
+        if (!this->started) return false;
+        if (depth > 0 || quote != 0)
+            throw SyntaxError(ErrorCode::Parentheses, "[parentheses error] Parentheses are not well-matched.", this->start);
+        return this->yield(form);
+    }
+
+} // namespace lisp
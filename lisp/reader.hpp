@@ -0,0 +1,42 @@
+#ifndef READER_HPP
+#define READER_HPP
+
+#include "error.hpp"
+
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <string_view>
+
+namespace lisp {
+
+    // splits a stream into top-level forms; reads `chunk_size` bytes at a time and
+    // keeps only the unfinished form in memory.
+    // with a string_view source (e.g. a MappedFile) forms point into the source itself.
+    class Reader {
+    private:
+        std::istream* input = nullptr;
+        std::string buffer;
+        std::string_view text;
+        size_t chunk_size = 0;
+        size_t begin = 0;
+        size_t pos = 0;
+        bool started = false;
+        SourcePosition now{1, 1};       // of text[pos]
+        SourcePosition start;           // of the current form
+
+        void advance(char c);
+        bool fill();
+        bool yield(std::string_view& form);
+
+    public:
+        Reader(std::istream& input, size_t chunk_size = 1 << 16);
+        Reader(std::string_view source);
+        bool next(std::string_view& form);
+        // where the form returned last starts in the stream
+        SourcePosition position() const { return this->start; }
+    };
+
+} // namespace lisp
+
+#endif
@@ -0,0 +1,101 @@
+#include "resolver.hpp"
+
+namespace lisp {
+
+    /* Resolver */
+    // finds `name` as seen from `at_depth` inside the innermost `function_count` functions.
+    // a local of an enclosing function is added to the captures of the inner one.
+    bool Resolver::lookup(SymbolId name, size_t function_count, int at_depth, int& found_depth, int& found_slot) {
+        auto it = this->scope.rbegin();
+        while (it != this->scope.rend() && (it->depth > at_depth || it->name != name)) it++;
+        if (it == this->scope.rend()) return false;
+
+        int boundary = function_count == 0 ? 0 : this->functions[function_count - 1].depth;
+        if (it->depth >= boundary) {
+            found_depth = at_depth - it->depth;
+            found_slot = it->slot;
+            return true;
+        }
+
+        Function& function = this->functions[function_count - 1];
+        size_t index = 0;
+        while (index < function.captured.size() && function.captured[index] != name) index++;
+        if (index == function.captured.size()) {
+            int outer_depth, outer_slot;
+            this->lookup(name, function_count - 1, function.depth - 1, outer_depth, outer_slot);
+            function.captured.push_back(name);
+            function.node->captures.push_back({outer_depth, outer_slot});
+        }
+        found_depth = at_depth - function.depth;
+        found_slot = (int)(function.node->parameters.size() + index);
+        return true;
+    }
+
+    void Resolver::resolve_node(ASTNode* node) {
+        if (node->kind == NodeKind::Symbol) {
+            SymbolNode* symbol = (SymbolNode*)node;
+            if (!this->lookup(symbol->symbol_id, this->functions.size(), this->depth, symbol->depth, symbol->slot))
+                symbol->depth = -1;
+            return;
+        }
+        if (node->kind == NodeKind::Function) return this->resolve_function((FunctionNode*)node);
+        if (node->kind != NodeKind::List) return;
+
+        std::vector<ASTNode*>& sub_nodes = ((ListNode*)node)->sub_nodes;
+        if (sub_nodes.size() == 0) return;
+
+        SymbolId oper = sub_nodes[0]->kind == NodeKind::Symbol ? ((SymbolNode*)sub_nodes[0])->symbol_id : SYM_BUILTIN_COUNT;
+        switch (oper) {
+        case SYM_DEF:
+            if (sub_nodes.size() == 3) this->resolve_node(sub_nodes[2]);
+            return;
+        case SYM_LET:
+            if (sub_nodes.size() == 3 && sub_nodes[1]->kind == NodeKind::List)
+                this->resolve_let((ListNode*)sub_nodes[1], sub_nodes[2]);
+            return;
+        default:
+            // the head is resolved too, as a call evaluates it like its arguments
+            for (ASTNode* sub_node : sub_nodes)
+                this->resolve_node(sub_node);
+        }
+    }
+
+    void Resolver::resolve_let(ListNode* parameters, ASTNode* expression) {
+        if (parameters->sub_nodes.size() % 2 == 1) return;
+        size_t outer = this->scope.size();
+        this->depth++;
+        bool complete = true;
+        for (size_t i = 0; i < parameters->sub_nodes.size(); i += 2) {
+            if (parameters->sub_nodes[i]->kind != NodeKind::Symbol) {
+                complete = false;
+                break;
+            }
+            // a binding sees the ones before it, but not itself
+            this->resolve_node(parameters->sub_nodes[i + 1]);
+            this->scope.push_back({((SymbolNode*)parameters->sub_nodes[i])->symbol_id, this->depth, (int)(i / 2)});
+        }
+        if (complete) this->resolve_node(expression);
+        this->scope.resize(outer);
+        this->depth--;
+    }
+
+    void Resolver::resolve_function(FunctionNode* function) {
+        // captures are found again on every resolve, so a form may be resolved twice
+        function->captures.clear();
+        size_t outer = this->scope.size();
+        this->depth++;
+        this->functions.push_back({function, this->depth, {}});
+        for (size_t i = 0; i < function->parameters.size(); i++)
+            this->scope.push_back({function->parameters[i], this->depth, (int)i});
+        this->resolve_node(function->body);
+        this->functions.pop_back();
+        this->scope.resize(outer);
+        this->depth--;
+    }
+
+    void Resolver::resolve(ASTNode* root) {
+        Resolver resolver;
+        resolver.resolve_node(root);
+    }
+
+} // namespace lisp
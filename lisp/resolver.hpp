@@ -0,0 +1,41 @@
+#ifndef RESOLVER_HPP
+#define RESOLVER_HPP
+
+#include "astnode.hpp"
+#include "symbol.hpp"
+
+#include <vector>
+
+namespace lisp {
+
+    // turns every local symbol reference of a form into a (depth, slot) pair.
+    // a let* frame has one slot per binding; slot of i-th binding is i.
+    // a fn* frame has its parameters, then the locals it captures from outside.
+    // malformed forms are left for the evaluator to report, in its own order.
+    class Resolver {
+    private:
+        struct Binding {
+            SymbolId name;
+            int depth;
+            int slot;
+        };
+        struct Function {
+            FunctionNode* node;
+            int depth;
+            std::vector<SymbolId> captured;
+        };
+        std::vector<Binding> scope;
+        std::vector<Function> functions;
+        int depth = 0;
+
+        bool lookup(SymbolId name, size_t function_count, int at_depth, int& found_depth, int& found_slot);
+        void resolve_node(ASTNode* node);
+        void resolve_let(ListNode* parameters, ASTNode* expression);
+        void resolve_function(FunctionNode* function);
+    public:
+        static void resolve(ASTNode* root);
+    };
+
+} // namespace lisp
+
+#endif
@@ -0,0 +1,420 @@
+#include "server.hpp"
+
+#include "cache.hpp"
+#include "error.hpp"
+#include "evaluator.hpp"
+#include "heap.hpp"
+#include "image.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LISP_HAS_SOCKETS 1
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace lisp {
+
+    // set by stop_server(), which may run in a signal handler
+    static std::atomic<bool> stopping{false};
+    static std::atomic<int> wake_fd{-1};
+
+#ifdef LISP_HAS_SOCKETS
+    /* frames */
+    static bool __read_exact(int fd, char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::read(fd, data, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+    static bool __write_all(int fd, const char* data, size_t size) {
+#ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL;     // a client which is gone is an error, not a SIGPIPE
+#else
+        const int flags = 0;
+#endif
+        while (size > 0) {
+            ssize_t n = ::send(fd, data, size, flags);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+    static void __put_length(std::string& frame, std::uint32_t length) {
+        for (int shift = 24; shift >= 0; shift -= 8) frame += (char)((length >> shift) & 0xff);
+    }
+
+    static bool __read_length(int fd, std::uint32_t& length) {
+        unsigned char bytes[4];
+        if (!__read_exact(fd, (char*)bytes, 4)) return false;
+        length = (std::uint32_t)bytes[0] << 24 | (std::uint32_t)bytes[1] << 16 | (std::uint32_t)bytes[2] << 8 | bytes[3];
+        return true;
+    }
+
+    // one send for the whole frame
+    bool write_request(int fd, std::string_view source) {
+        std::string frame;
+        frame.reserve(4 + source.size());
+        __put_length(frame, (std::uint32_t)source.size());
+        frame += source;
+        return __write_all(fd, frame.data(), frame.size());
+    }
+
+    bool read_request(int fd, std::string& source, std::uint32_t limit) {
+        std::uint32_t length;
+        if (!__read_length(fd, length) || length > limit) return false;
+        source.resize(length);
+        return __read_exact(fd, source.data(), length);
+    }
+
+    bool write_response(int fd, bool ok, std::string_view output) {
+        std::string frame;
+        frame.reserve(5 + output.size());
+        frame += (char)(ok ? 0 : 1);
+        __put_length(frame, (std::uint32_t)output.size());
+        frame += output;
+        return __write_all(fd, frame.data(), frame.size());
+    }
+
+    bool read_response(int fd, bool& ok, std::string& output) {
+        char status;
+        std::uint32_t length;
+        if (!__read_exact(fd, &status, 1) || !__read_length(fd, length)) return false;
+        ok = status == 0;
+        output.resize(length);
+        return __read_exact(fd, output.data(), length);
+    }
+
+    static bool __address(const std::string& path, sockaddr_un& address) {
+        address = sockaddr_un();
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) return false;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    int connect_server(const std::string& path) {
+        sockaddr_un address;
+        if (!__address(path, address)) return -1;
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (::connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    void close_connection(int fd) {
+        if (fd >= 0) ::close(fd);
+    }
+
+    // ends the poll() of the listening thread
+    static void __wake() {
+        int fd = wake_fd.load();
+        if (fd >= 0) {
+            char byte = 0;
+            ssize_t written = ::write(fd, &byte, 1);
+            (void)written;
+        }
+    }
+
+    void stop_server() {
+        stopping.store(true);
+        __wake();
+    }
+
+    /* server */
+    // what the listening thread and the workers share
+    struct ServerState {
+        const ServerOptions& options;
+        std::mutex lock;
+        std::condition_variable changed;
+        std::deque<int> waiting;            // with a request to read, not yet taken by a worker
+        std::vector<int> served;            // served by a worker, not yet polled again
+        std::unordered_set<int> open;       // every connection not closed yet
+        bool closed = false;                // no more connections; the workers finish
+        size_t warm = 0;                    // workers ready to serve, or failed
+        std::exception_ptr error;           // of the first worker which failed to warm up
+        std::atomic<size_t> requests{0};
+        std::atomic<size_t> failed{0};
+        std::atomic<size_t> connections{0};
+
+        ServerState(const ServerOptions& options) : options(options) {}
+
+        bool take(int& fd) {
+            std::unique_lock<std::mutex> guard(this->lock);
+            this->changed.wait(guard, [this] { return this->closed || !this->waiting.empty(); });
+            if (this->waiting.empty()) return false;
+            fd = this->waiting.front();
+            this->waiting.pop_front();
+            return true;
+        }
+
+        // the listening thread waits for the next request of the connection
+        void give_back(int fd) {
+            {
+                std::lock_guard<std::mutex> guard(this->lock);
+                this->served.push_back(fd);
+            }
+            __wake();
+        }
+
+        // closed under the lock, so that stopping never shuts down a reused descriptor
+        void drop(int fd) {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->open.erase(fd);
+            ::close(fd);
+        }
+    };
+
+    static void __run_prelude(const ServerOptions& options, Evaluator& base) {
+        std::ifstream file(options.prelude);
+        if (!file.is_open())
+            throw SyntaxError(ErrorCode::Server, "[server error] Prelude file is inaccessible.");
+        std::stringstream source;
+        source << file.rdbuf();
+        std::ostringstream discarded;
+        run_source(source.str(), base, nullptr, options.run, discarded);
+    }
+
+    // one request in a session of its own; the output is what main prints
+    static bool __serve_request(const std::string& source, Evaluator& base, FormCache* cache,
+                                const RunOptions& options, std::string& output) {
+        std::ostringstream out;
+        bool ok = true;
+        {
+            std::unique_ptr<Evaluator> session = Evaluator::session(base);
+            session->use_jit(options.jit);
+            try {
+                run_source(source, *session, cache, options, out);
+            } catch (const std::exception& error) {
+                out << error.what() << "\n";
+                ok = false;
+            }
+        }
+        output = out.str();
+        return ok;
+    }
+
+    // a worker: a heap, the warm evaluator and its cache, then one request at a time until closed
+    static void __work(ServerState& state) {
+        const ServerOptions& options = state.options;
+        Heap local;
+        if (options.gc_threshold > 0) local.configure(options.gc_threshold, 2.0);
+        use_heap(&local);
+        {
+            std::unique_ptr<Evaluator> base;
+            std::unique_ptr<FormCache> cache;
+            bool ready = true;
+            try {
+                base = std::make_unique<Evaluator>();
+                base->use_jit(options.run.jit);
+                if (!options.run.image.empty()) load_image(options.run.image, *base);
+                if (!options.prelude.empty()) __run_prelude(options, *base);
+                if (options.run.cache > 0) cache = std::make_unique<FormCache>(options.run.cache);
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(state.lock);
+                if (!state.error) state.error = std::current_exception();
+                ready = false;
+            }
+            {
+                std::lock_guard<std::mutex> guard(state.lock);
+                state.warm++;
+            }
+            state.changed.notify_all();
+
+            int fd;
+            std::string source;
+            std::string output;
+            while (ready && state.take(fd)) {
+                if (!read_request(fd, source, options.max_request)) {
+                    state.drop(fd);
+                    continue;
+                }
+                bool ok = __serve_request(source, *base, cache.get(), options.run, output);
+                state.requests++;
+                if (!ok) state.failed++;
+                if (write_response(fd, ok, output)) state.give_back(fd);
+                else state.drop(fd);
+            }
+            // the cache goes first; its forms are marked by the heap of this thread
+            cache.reset();
+            base.reset();
+        }
+        use_heap(nullptr);
+    }
+
+    // joins the workers however serve() ends
+    struct Workers {
+        ServerState& state;
+        std::vector<std::thread> threads;
+        ~Workers() {
+            {
+                std::lock_guard<std::mutex> guard(state.lock);
+                state.closed = true;
+                // a worker waiting for a request sees the end of its connection
+                for (int fd : state.open) ::shutdown(fd, SHUT_RD);
+            }
+            state.changed.notify_all();
+            for (std::thread& thread : threads) thread.join();
+            // the idle connections, which no worker holds
+            for (int fd : state.open) ::close(fd);
+            state.open.clear();
+        }
+    };
+
+    // a pipe whose read end wakes the listening thread
+    struct WakePipe {
+        int fds[2] = {-1, -1};
+        WakePipe() {
+            if (::pipe(this->fds) != 0)
+                throw SyntaxError(ErrorCode::Server, "[server error] Socket is inaccessible.");
+            // drained without blocking, however many wakes came
+            ::fcntl(this->fds[0], F_SETFL, ::fcntl(this->fds[0], F_GETFL) | O_NONBLOCK);
+            wake_fd.store(this->fds[1]);
+        }
+        ~WakePipe() {
+            wake_fd.store(-1);
+            ::close(this->fds[0]);
+            ::close(this->fds[1]);
+        }
+    };
+
+    struct Listener {
+        int fd = -1;
+        std::string path;
+        ~Listener() {
+            if (this->fd < 0) return;
+            ::close(this->fd);
+            ::unlink(this->path.c_str());
+        }
+    };
+
+    void serve(const ServerOptions& options, std::ostream& log) {
+        sockaddr_un address;
+        if (!__address(options.path, address))
+            throw SyntaxError(ErrorCode::Server, "[server error] Socket path is too long.");
+        // a socket file which refuses connections was left by a server which is gone
+        int probe = connect_server(options.path);
+        if (probe >= 0) {
+            close_connection(probe);
+            throw SyntaxError(ErrorCode::Server, "[server error] Socket is in use.");
+        }
+
+        stopping.store(false);
+        WakePipe wake;
+
+        ServerState state(options);
+        size_t count = options.workers > 0 ? options.workers : std::max(1u, std::thread::hardware_concurrency());
+        {
+            Workers workers{state, {}};
+            for (size_t i = 0; i < count; i++) workers.threads.emplace_back(__work, std::ref(state));
+            {
+                std::unique_lock<std::mutex> guard(state.lock);
+                state.changed.wait(guard, [&] { return state.warm == count; });
+                if (state.error) std::rethrow_exception(state.error);
+            }
+
+            // bound once every worker is warm, so that the first client is served at once
+            Listener listener;
+            listener.fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (listener.fd < 0)
+                throw SyntaxError(ErrorCode::Server, "[server error] Socket is inaccessible.");
+            ::unlink(options.path.c_str());
+            listener.path = options.path;
+            if (::bind(listener.fd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(listener.fd, 128) != 0)
+                throw SyntaxError(ErrorCode::Server, "[server error] Socket is inaccessible.");
+            log << "{Server} " << options.path << ": " << count << " workers\n";
+            log.flush();
+
+            // the connections between requests are polled here, and one with a request
+            // goes to the next free worker, so that any number of clients share the workers
+            std::vector<int> idle;
+            std::vector<pollfd> fds;
+            while (!stopping.load()) {
+                fds.clear();
+                fds.push_back({listener.fd, POLLIN, 0});
+                fds.push_back({wake.fds[0], POLLIN, 0});
+                for (int fd : idle) fds.push_back({fd, POLLIN, 0});
+                if (::poll(fds.data(), fds.size(), -1) < 0) {
+                    if (errno == EINTR) continue;
+                    break;
+                }
+                size_t ready = 0;
+                {
+                    std::lock_guard<std::mutex> guard(state.lock);
+                    idle.clear();
+                    for (size_t i = 2; i < fds.size(); i++) {
+                        if (fds[i].revents != 0) {
+                            state.waiting.push_back(fds[i].fd);
+                            ready++;
+                        } else {
+                            idle.push_back(fds[i].fd);
+                        }
+                    }
+                    if (fds[1].revents != 0) {
+                        char bytes[64];
+                        while (::read(wake.fds[0], bytes, sizeof(bytes)) > 0) {}
+                        idle.insert(idle.end(), state.served.begin(), state.served.end());
+                        state.served.clear();
+                    }
+                    if (fds[0].revents & POLLIN) {
+                        int fd = ::accept(listener.fd, nullptr, nullptr);
+                        if (fd >= 0) {
+                            state.open.insert(fd);
+                            idle.push_back(fd);
+                            state.connections++;
+                        }
+                    }
+                }
+                if (ready == 1) state.changed.notify_one();
+                else if (ready > 1) state.changed.notify_all();
+            }
+        }
+        log << "{Server} requests: " << state.requests << ", failed: " << state.failed
+            << ", connections: " << state.connections << "\n";
+    }
+#else
+    bool write_request(int, std::string_view) { return false; }
+    bool read_request(int, std::string&, std::uint32_t) { return false; }
+    bool write_response(int, bool, std::string_view) { return false; }
+    bool read_response(int, bool&, std::string&) { return false; }
+    int connect_server(const std::string&) { return -1; }
+    void close_connection(int) {}
+
+    void stop_server() {
+        stopping.store(true);
+    }
+
+    void serve(const ServerOptions&, std::ostream&) {
+        throw SyntaxError(ErrorCode::Server, "[server error] Unix domain sockets are not supported.");
+    }
+#endif
+
+} // namespace lisp
@@ -0,0 +1,56 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include "batch.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace lisp {
+
+    struct ServerOptions {
+        RunOptions run;             // use_vm, fold, jit, cache and image of every worker
+        std::string path;           // of the Unix domain socket
+        std::string prelude;        // script each worker runs after the image, before serving
+        size_t workers = 0;         // 0 is the number of hardware threads
+        size_t gc_threshold = 0;    // min_threshold of each heap; 0 keeps the default
+        std::uint32_t max_request = 16 << 20;  // bytes; a longer request closes its connection
+    };
+
+    // protocol over a stream socket; lengths are 4 bytes, most significant first.
+    //   request:  length, then the source of one or more forms
+    //   response: status (1 byte: 0 ok, 1 error), length, then the output
+    // the output is what main prints for the forms, and after a failed form its error,
+    // which ends the request. a connection carries any number of requests in turn.
+    // these return false once the connection is closed or broken.
+    bool write_request(int fd, std::string_view source);
+    bool read_request(int fd, std::string& source, std::uint32_t limit);
+    bool write_response(int fd, bool ok, std::string_view output);
+    bool read_response(int fd, bool& ok, std::string& output);
+    // -1 if nothing listens at `path`
+    int connect_server(const std::string& path);
+    void close_connection(int fd);
+
+    // serves requests at `options.path` until stop_server(). every worker is a thread with
+    // its own Heap and a warm Evaluator: the natives, the image and the prelude are loaded
+    // once, and its FormCache keeps the forms of earlier requests. each request runs in a
+    // session over those globals (Evaluator::session), so its def! are gone after it;
+    // its future, pmap and pcall run on the pool of the warm Evaluator, kept for later requests.
+    // a worker takes one request at a time, from whichever connection has one ready.
+    //
+    // the workers share no globals: a Heap marks and sweeps only its own objects, from the
+    // thread which owns it, so one frozen environment read by every worker would have its
+    // objects marked by several collectors at once. each worker loads the image and runs
+    // the prelude into its own globals instead, which costs their time and memory once per
+    // worker; --workers bounds both.
+    // throws `[server error] ...` when the socket cannot be made, or the error of a prelude.
+    void serve(const ServerOptions& options, std::ostream& log);
+    // may be called from a signal handler
+    void stop_server();
+
+} // namespace lisp
+
+#endif
@@ -0,0 +1,276 @@
+#include "simd.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define LISP_AVX2 1
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace lisp {
+
+    // dot products are summed as high and low 32-bit halves, which cannot
+    // overflow 64 bits; returns false if hi * 2^32 + lo does not fit in Int.
+    static bool combine(long long hi, long long lo, int& result) {
+        hi += lo / 4294967296LL;
+        lo %= 4294967296LL;
+        if (!((hi == 0 && lo <= INT_MAX) || (hi == -1 && lo >= 2147483648LL))) return false;
+        result = (int)(hi * 4294967296LL + lo);
+        return true;
+    }
+
+    /* scalar kernels */
+    static bool add_scalar(const int* a, const int* b, int* out, size_t n) {
+        bool fits = true;
+        for (size_t i = 0; i < n; i++) {
+            long long r = (long long)a[i] + b[i];
+            fits &= r >= INT_MIN && r <= INT_MAX;
+            out[i] = (int)r;
+        }
+        return fits;
+    }
+
+    static bool sub_scalar(const int* a, const int* b, int* out, size_t n) {
+        bool fits = true;
+        for (size_t i = 0; i < n; i++) {
+            long long r = (long long)a[i] - b[i];
+            fits &= r >= INT_MIN && r <= INT_MAX;
+            out[i] = (int)r;
+        }
+        return fits;
+    }
+
+    static bool mul_scalar(const int* a, const int* b, int* out, size_t n) {
+        bool fits = true;
+        for (size_t i = 0; i < n; i++) {
+            long long r = (long long)a[i] * b[i];
+            fits &= r >= INT_MIN && r <= INT_MAX;
+            out[i] = (int)r;
+        }
+        return fits;
+    }
+
+    static long long sum_scalar(const int* a, size_t n) {
+        long long result = 0;
+        for (size_t i = 0; i < n; i++) result += a[i];
+        return result;
+    }
+
+    static int min_scalar(const int* a, size_t n) {
+        int result = a[0];
+        for (size_t i = 1; i < n; i++) result = a[i] < result ? a[i] : result;
+        return result;
+    }
+
+    static int max_scalar(const int* a, size_t n) {
+        int result = a[0];
+        for (size_t i = 1; i < n; i++) result = a[i] > result ? a[i] : result;
+        return result;
+    }
+
+    static void dot_halves(const int* a, const int* b, size_t n, long long& hi, long long& lo) {
+        for (size_t i = 0; i < n; i++) {
+            long long p = (long long)a[i] * b[i];
+            long long low = p & 0xffffffffLL;
+            hi += (p - low) / 4294967296LL;
+            lo += low;
+        }
+    }
+
+    static bool dot_scalar(const int* a, const int* b, size_t n, int& result) {
+        long long hi = 0, lo = 0;
+        dot_halves(a, b, n, hi, lo);
+        return combine(hi, lo, result);
+    }
+
+    static size_t filter_scalar(const int* a, size_t n, int order, int x, int* out) {
+        size_t count = 0;
+        for (size_t i = 0; i < n; i++) {
+            int e = a[i];
+            if ((e > x) - (e < x) == order) out[count++] = e;
+        }
+        return count;
+    }
+
+    static const VectorKernels scalar_kernels = {
+        "scalar", add_scalar, sub_scalar, mul_scalar, sum_scalar, min_scalar, max_scalar, dot_scalar, filter_scalar
+    };
+
+#ifdef LISP_AVX2
+    /* AVX2 kernels; eight Ints per step, the rest by the scalar kernels */
+    AVX2_TARGET static bool none_negative(__m256i flags) {
+        return _mm256_movemask_ps(_mm256_castsi256_ps(flags)) == 0;
+    }
+
+    // a + b overflows iff the sign of the result differs from the signs of both operands
+    AVX2_TARGET static bool add_avx2(const int* a, const int* b, int* out, size_t n) {
+        __m256i overflow = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+            __m256i r = _mm256_add_epi32(x, y);
+            overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(x, r), _mm256_xor_si256(y, r)));
+            _mm256_storeu_si256((__m256i*)(out + i), r);
+        }
+        return add_scalar(a + i, b + i, out + i, n - i) && none_negative(overflow);
+    }
+
+    // a - b overflows iff the operands differ in sign and the result differs from a
+    AVX2_TARGET static bool sub_avx2(const int* a, const int* b, int* out, size_t n) {
+        __m256i overflow = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+            __m256i r = _mm256_sub_epi32(x, y);
+            overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(x, y), _mm256_xor_si256(x, r)));
+            _mm256_storeu_si256((__m256i*)(out + i), r);
+        }
+        return sub_scalar(a + i, b + i, out + i, n - i) && none_negative(overflow);
+    }
+
+    // the 64-bit products of even and odd lanes fit in Int iff p + 2^31 < 2^32
+    AVX2_TARGET static bool mul_avx2(const int* a, const int* b, int* out, size_t n) {
+        const __m256i bias = _mm256_set1_epi64x(0x80000000LL);
+        __m256i overflow = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+            __m256i even = _mm256_mul_epi32(x, y);
+            __m256i odd = _mm256_mul_epi32(_mm256_srli_epi64(x, 32), _mm256_srli_epi64(y, 32));
+            overflow = _mm256_or_si256(overflow, _mm256_srli_epi64(_mm256_add_epi64(even, bias), 32));
+            overflow = _mm256_or_si256(overflow, _mm256_srli_epi64(_mm256_add_epi64(odd, bias), 32));
+            _mm256_storeu_si256((__m256i*)(out + i), _mm256_mullo_epi32(x, y));
+        }
+        return mul_scalar(a + i, b + i, out + i, n - i) && _mm256_testz_si256(overflow, overflow);
+    }
+
+    AVX2_TARGET static long long sum_avx2(const int* a, size_t n) {
+        __m256i total = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+            total = _mm256_add_epi64(total, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)));
+            total = _mm256_add_epi64(total, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1)));
+        }
+        long long lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, total);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_scalar(a + i, n - i);
+    }
+
+    AVX2_TARGET static int min_avx2(const int* a, size_t n) {
+        if (n < 8) return min_scalar(a, n);
+        __m256i result = _mm256_loadu_si256((const __m256i*)a);
+        size_t i = 8;
+        for (; i + 8 <= n; i += 8)
+            result = _mm256_min_epi32(result, _mm256_loadu_si256((const __m256i*)(a + i)));
+        int lanes[8];
+        _mm256_storeu_si256((__m256i*)lanes, result);
+        int rest = min_scalar(lanes, 8);
+        return i < n ? std::min(rest, min_scalar(a + i, n - i)) : rest;
+    }
+
+    AVX2_TARGET static int max_avx2(const int* a, size_t n) {
+        if (n < 8) return max_scalar(a, n);
+        __m256i result = _mm256_loadu_si256((const __m256i*)a);
+        size_t i = 8;
+        for (; i + 8 <= n; i += 8)
+            result = _mm256_max_epi32(result, _mm256_loadu_si256((const __m256i*)(a + i)));
+        int lanes[8];
+        _mm256_storeu_si256((__m256i*)lanes, result);
+        int rest = max_scalar(lanes, 8);
+        return i < n ? std::max(rest, max_scalar(a + i, n - i)) : rest;
+    }
+
+    // four 64-bit products per step, split into their high (signed) and low (unsigned) halves
+    AVX2_TARGET static bool dot_avx2(const int* a, const int* b, size_t n, int& result) {
+        const __m256i low_mask = _mm256_set1_epi64x(0xffffffffLL);
+        const __m256i odd_lanes = _mm256_setr_epi32(1, 3, 5, 7, 0, 0, 0, 0);
+        __m256i hi = _mm256_setzero_si256(), lo = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i x = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(a + i)));
+            __m256i y = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(b + i)));
+            __m256i p = _mm256_mul_epi32(x, y);
+            lo = _mm256_add_epi64(lo, _mm256_and_si256(p, low_mask));
+            __m128i high = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(p, odd_lanes));
+            hi = _mm256_add_epi64(hi, _mm256_cvtepi32_epi64(high));
+        }
+        long long his[4], los[4];
+        _mm256_storeu_si256((__m256i*)his, hi);
+        _mm256_storeu_si256((__m256i*)los, lo);
+        long long hi_total = his[0] + his[1] + his[2] + his[3];
+        long long lo_total = los[0] + los[1] + los[2] + los[3];
+        dot_halves(a + i, b + i, n - i, hi_total, lo_total);
+        return combine(hi_total, lo_total, result);
+    }
+
+    // permutation which moves the lanes selected by each 8-bit mask to the front
+    struct PackTable {
+        int lanes[256][8];
+        PackTable() {
+            for (int mask = 0; mask < 256; mask++) {
+                int count = 0;
+                for (int lane = 0; lane < 8; lane++)
+                    if (mask & (1 << lane)) this->lanes[mask][count++] = lane;
+                while (count < 8) this->lanes[mask][count++] = 0;
+            }
+        }
+    };
+
+    AVX2_TARGET static size_t filter_avx2(const int* a, size_t n, int order, int x, int* out) {
+        static const PackTable table;
+        const __m256i pivot = _mm256_set1_epi32(x);
+        size_t count = 0;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i e = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i keep = order < 0 ? _mm256_cmpgt_epi32(pivot, e)
+                         : order > 0 ? _mm256_cmpgt_epi32(e, pivot)
+                         : _mm256_cmpeq_epi32(e, pivot);
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(keep));
+            __m256i lanes = _mm256_loadu_si256((const __m256i*)table.lanes[mask]);
+            // writes 8 Ints, but `out + count + 8` never passes `out + i + 8`
+            _mm256_storeu_si256((__m256i*)(out + count), _mm256_permutevar8x32_epi32(e, lanes));
+            count += __builtin_popcount(mask);
+        }
+        return count + filter_scalar(a + i, n - i, order, x, out + count);
+    }
+
+    static const VectorKernels avx2_kernels = {
+        "avx2", add_avx2, sub_avx2, mul_avx2, sum_avx2, min_avx2, max_avx2, dot_avx2, filter_avx2
+    };
+#endif
+
+    static const VectorKernels* best_kernels() {
+#ifdef LISP_AVX2
+        if (__builtin_cpu_supports("avx2")) return &avx2_kernels;
+#endif
+        return &scalar_kernels;
+    }
+
+    // atomic, since the first call may come from any thread: a pool worker, a script of
+    // run_batch or a server worker
+    static std::atomic<const VectorKernels*> selected{nullptr};
+
+    const VectorKernels& vector_kernels() {
+        const VectorKernels* kernels = selected.load(std::memory_order_acquire);
+        if (kernels == nullptr) {
+            const VectorKernels* best = best_kernels();
+            // a racing use_simd() wins over the default
+            if (!selected.compare_exchange_strong(kernels, best, std::memory_order_acq_rel)) return *kernels;
+            kernels = best;
+        }
+        return *kernels;
+    }
+
+    void use_simd(bool enabled) {
+        selected.store(enabled ? best_kernels() : &scalar_kernels, std::memory_order_release);
+    }
+
+} // namespace lisp
@@ -0,0 +1,34 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include <cstddef>
+
+namespace lisp {
+
+    // bulk kernels over Int arrays, used by the vector builtins (see vector.hpp).
+    // one table per instruction set; vector_kernels() picks the best one the CPU
+    // supports, at the first call.
+    struct VectorKernels {
+        const char* name;
+        // element-wise; `out` may be `a` or `b`. false if a result does not fit in Int.
+        bool (*add)(const int* a, const int* b, int* out, size_t n);
+        bool (*sub)(const int* a, const int* b, int* out, size_t n);
+        bool (*mul)(const int* a, const int* b, int* out, size_t n);
+        // exact, for n < 2^32
+        long long (*sum)(const int* a, size_t n);
+        // n > 0
+        int (*min)(const int* a, size_t n);
+        int (*max)(const int* a, size_t n);
+        // false if the result does not fit in Int
+        bool (*dot)(const int* a, const int* b, size_t n, int& result);
+        // copies the elements `e` with `e <=> x` equal to `order` (-1, 0 or 1) to `out`; returns their count
+        size_t (*filter)(const int* a, size_t n, int order, int x, int* out);
+    };
+
+    const VectorKernels& vector_kernels();
+    // false forces the scalar kernels, e.g. to compare them with the SIMD ones
+    void use_simd(bool enabled);
+
+} // namespace lisp
+
+#endif
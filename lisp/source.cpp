@@ -0,0 +1,83 @@
+#include "source.hpp"
+
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LISP_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lisp {
+
+    /* MappedFile */
+    MappedFile::~MappedFile() {
+        this->close();
+    }
+
+    bool MappedFile::open(const std::string& path) {
+        this->close();
+#ifdef LISP_HAS_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        this->size = (size_t)st.st_size;
+        if (this->size > 0) {
+            void* ptr = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr == MAP_FAILED) {
+                ::close(fd);
+                this->size = 0;
+                return false;
+            }
+            madvise(ptr, this->size, MADV_SEQUENTIAL);
+            this->data = (const char*)ptr;
+        }
+        ::close(fd);
+        return true;
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) return false;
+        std::ostringstream content;
+        content << file.rdbuf();
+        this->fallback = content.str();
+        this->data = this->fallback.data();
+        this->size = this->fallback.size();
+        return true;
+#endif
+    }
+
+    void MappedFile::close() {
+#ifdef LISP_HAS_MMAP
+        if (this->data != nullptr) munmap((void*)this->data, this->size);
+#endif
+        this->fallback.clear();
+        this->data = nullptr;
+        this->size = 0;
+        this->discarded = 0;
+    }
+
+    std::string_view MappedFile::view() const {
+        return std::string_view(this->data, this->size);
+    }
+
+    // drop already parsed pages from memory; nothing before `ptr` may be used afterwards.
+    void MappedFile::discard_before(const char* ptr) {
+#ifdef LISP_HAS_MMAP
+        const size_t step = 16 << 20;
+        size_t offset = ptr - this->data;
+        if (this->data == nullptr || offset < this->discarded + step) return;
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t upto = offset / page * page;
+        madvise((void*)(this->data + this->discarded), upto - this->discarded, MADV_DONTNEED);
+        this->discarded = upto;
+#endif
+    }
+
+} // namespace lisp
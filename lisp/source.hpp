@@ -0,0 +1,32 @@
+#ifndef SOURCE_HPP
+#define SOURCE_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace lisp {
+
+    // read-only view of a whole file; mmap on POSIX, a plain copy elsewhere.
+    class MappedFile {
+    private:
+        const char* data = nullptr;
+        size_t size = 0;
+        size_t discarded = 0;
+        std::string fallback;
+
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const std::string& path);
+        void close();
+        std::string_view view() const;
+        void discard_before(const char* ptr);
+    };
+
+} // namespace lisp
+
+#endif
@@ -0,0 +1,45 @@
+#include "symbol.hpp"
+
+namespace lisp {
+
+    /* SymbolTable */
+    SymbolTable::SymbolTable() {
+        const char* builtins[SYM_BUILTIN_COUNT] = { "def!", "let*", "+", "-", "*", "/", "fn*", "if", "=", "<" };
+        for (const char* name : builtins) this->intern(name);
+    }
+
+    SymbolId SymbolTable::intern(std::string_view name) {
+        std::lock_guard<std::mutex> guard(this->lock);
+        auto it = this->ids.find(name);
+        if (it != this->ids.end()) return it->second;
+        // deque never moves its elements, so the key view stays valid
+        this->names.emplace_back(name);
+        SymbolId id = (SymbolId)this->names.size() - 1;
+        this->ids.insert({this->names.back(), id});
+        return id;
+    }
+
+    const std::string& SymbolTable::name(SymbolId id) const {
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->names[id];
+    }
+
+    size_t SymbolTable::size() const {
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->names.size();
+    }
+
+    SymbolTable& symbol_table() {
+        static SymbolTable table;
+        return table;
+    }
+
+    SymbolId intern(std::string_view name) {
+        return symbol_table().intern(name);
+    }
+
+    const std::string& symbol_name(SymbolId id) {
+        return symbol_table().name(id);
+    }
+
+} // namespace lisp
@@ -0,0 +1,59 @@
+#ifndef SYMBOL_HPP
+#define SYMBOL_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace lisp {
+
+    typedef int SymbolId;
+
+    // reserved symbols; SymbolTable interns them first, in this order.
+    enum BuiltinSymbol : SymbolId {
+        SYM_DEF, SYM_LET, SYM_ADD, SYM_SUB, SYM_MUL, SYM_DIV,
+        SYM_FN, SYM_IF, SYM_EQ, SYM_LT,
+        SYM_BUILTIN_COUNT
+    };
+
+    // shared by every thread; ids are the same for all interpreters of a process.
+    class SymbolTable {
+    private:
+        mutable std::mutex lock;
+        std::deque<std::string> names;
+        std::unordered_map<std::string_view, SymbolId> ids;
+    public:
+        SymbolTable();
+        SymbolId intern(std::string_view name);
+        const std::string& name(SymbolId id) const;
+        size_t size() const;
+    };
+
+    // inline cache of one reference to a global: the slot of the name in the table of
+    // globals whose version is recorded with it (see Environment::get). the two are one
+    // word, since the workers of a ThreadPool run the same reference at the same time.
+    class GlobalCache {
+    private:
+        mutable std::atomic<std::uint64_t> key{0};     // version << SLOT_BITS | slot; 0 is empty
+        friend class Environment;
+    public:
+        static constexpr int SLOT_BITS = 24;
+        GlobalCache() = default;
+        GlobalCache(const GlobalCache& other) : key(other.key.load(std::memory_order_relaxed)) {}
+        GlobalCache& operator=(const GlobalCache& other) {
+            this->key.store(other.key.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            return *this;
+        }
+    };
+
+    SymbolTable& symbol_table();
+    SymbolId intern(std::string_view name);
+    const std::string& symbol_name(SymbolId id);
+
+} // namespace lisp
+
+#endif
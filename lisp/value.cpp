@@ -0,0 +1,91 @@
+#include "value.hpp"
+
+#include "astnode.hpp"
+#include "heap.hpp"
+
+#include <ostream>
+#include <utility>
+
+namespace lisp {
+
+    /* StringObject */
+    StringObject::StringObject(std::string_view text) : Object(ObjectKind::String), text(text) {}
+
+    size_t StringObject::footprint() const {
+        return sizeof(StringObject) + this->text.capacity();
+    }
+
+    /* CodeObject */
+    CodeObject::CodeObject(std::unique_ptr<Arena> arena) : Object(ObjectKind::Code), arena(std::move(arena)) {}
+
+    size_t CodeObject::footprint() const {
+        return sizeof(CodeObject) + this->arena->bytes_used();
+    }
+
+    /* ClosureObject */
+    ClosureObject::ClosureObject(FunctionNode* function) : Object(ObjectKind::Closure), function(function) {}
+
+    void ClosureObject::trace(Heap& heap) const {
+        heap.mark(this->function->owner);
+        for (const Value& value : this->captured) heap.mark(value);
+    }
+
+    size_t ClosureObject::footprint() const {
+        return sizeof(ClosureObject) + this->captured.capacity() * sizeof(Value);
+    }
+
+    /* NativeObject */
+    NativeObject::NativeObject(const char* name, int arity, NativeFunction function)
+        : Object(ObjectKind::Native), name(name), arity(arity), function(function) {}
+
+    size_t NativeObject::footprint() const {
+        return sizeof(NativeObject);
+    }
+
+    /* Value */
+    Value::Value(Object* object) : bits((std::uintptr_t)object) {
+        static_assert(alignof(Object) > TAG_MASK, "object pointers need three free tag bits");
+    }
+
+    Value::Value(const Literal& literal) : Value() {
+        switch (literal.index()) {
+        case 0: *this = integer(std::get<int>(literal)); break;
+        case 1: *this = character(std::get<char>(literal)); break;
+        case 2: *this = string(std::get<std::string>(literal)); break;
+        case 3: *this = boolean(std::get<bool>(literal)); break;
+        default: break;
+        }
+    }
+
+    Value Value::string(std::string_view text) {
+        return Value(heap().make<StringObject>(text));
+    }
+
+    Literal Value::literal() const {
+        switch (this->type()) {
+        case ValueType::Int: return this->as_int();
+        case ValueType::Char: return this->as_char();
+        case ValueType::Bool: return this->as_bool();
+        case ValueType::Null: return nullptr;
+        case ValueType::Object: break;
+        }
+        if (this->as_object()->kind == ObjectKind::String) return this->as_string();
+        return nullptr;
+    }
+
+    void print_value(std::ostream& out, const Value& value) {
+        switch (value.type()) {
+        case ValueType::Int: out << value.as_int(); return;
+        case ValueType::Char: out << "'" << value.as_char() << "'"; return;
+        case ValueType::Bool: out << (value.as_bool() ? "true" : "false"); return;
+        case ValueType::Null: out << "null"; return;
+        case ValueType::Object: break;
+        }
+        const Object* object = value.as_object();
+        if (object->kind == ObjectKind::String) out << '"' << value.as_string() << '"';
+        else if (object->type_name() != nullptr) object->print(out);
+        else if (object->kind == ObjectKind::Native) out << "#<native " << value.as_native()->name << ">";
+        else out << "#<function>";
+    }
+
+} // namespace lisp
@@ -0,0 +1,158 @@
+#ifndef VALUE_HPP
+#define VALUE_HPP
+
+#include "arena.hpp"
+#include "error.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+namespace lisp {
+
+    typedef std::variant<int, char, std::string, bool, std::nullptr_t> Literal;
+
+    class FunctionNode;
+    class ClosureObject;
+    class NativeObject;
+    class VectorObject;
+    class Heap;
+
+    enum class ObjectKind : std::uint8_t { String, Closure, Code, Native, Vector, Cons, PersistentVector, HashMap, Future };
+
+    // heap part of a runtime value; owned by the Heap, which frees it once it is
+    // neither reachable from a root nor pinned.
+    class Object {
+    public:
+        ObjectKind kind;
+        bool marked = false;
+        std::uint32_t pins = 0;
+        Object* next = nullptr;
+        virtual ~Object() = default;
+        virtual void trace(Heap&) const {}
+        virtual size_t footprint() const { return sizeof(Object); }
+        // vectors and collections print themselves; main shows `type_name()` after
+        // them. nullptr for objects printed through literal().
+        virtual const char* type_name() const { return nullptr; }
+        virtual void print(std::ostream&) const {}
+    protected:
+        Object(ObjectKind kind) : kind(kind) {}
+    };
+
+    class StringObject : public Object {
+    public:
+        std::string text;
+        StringObject(std::string_view text);
+        size_t footprint() const override;
+    };
+
+    // arena of a parsed form whose functions may outlive the Parser; kept while
+    // a closure of one of its FunctionNodes is alive.
+    class CodeObject : public Object {
+    public:
+        std::unique_ptr<Arena> arena;
+        CodeObject(std::unique_ptr<Arena> arena);
+        size_t footprint() const override;
+    };
+
+    enum class ValueType : std::uint8_t { Object, Int, Char, Bool, Null };
+
+    static_assert(sizeof(std::uintptr_t) == 8, "Value needs 64-bit pointers");
+
+    // one tagged word: the low 3 bits are the ValueType, immediates keep their
+    // payload in the upper 32 bits and objects are 8-byte aligned pointers.
+    // copying a Value never allocates or counts references; see Heap.
+    class Value {
+    private:
+        std::uintptr_t bits;
+
+        static constexpr std::uintptr_t TAG_MASK = 7;
+        static constexpr std::uintptr_t FAILURE = 7;        // a tag of no ValueType
+        static constexpr int PAYLOAD_SHIFT = 32;
+
+        explicit Value(std::uintptr_t bits) : bits(bits) {}
+        static Value immediate(ValueType type, std::uint32_t payload) {
+            return Value(((std::uintptr_t)payload << PAYLOAD_SHIFT) | (std::uintptr_t)type);
+        }
+        std::uint32_t payload() const { return (std::uint32_t)(this->bits >> PAYLOAD_SHIFT); }
+
+    public:
+        Value() : bits((std::uintptr_t)ValueType::Null) {}
+        explicit Value(Object* object);
+        explicit Value(const Literal& literal);
+
+        static Value integer(int value) { return immediate(ValueType::Int, (std::uint32_t)value); }
+        static Value character(char value) { return immediate(ValueType::Char, (unsigned char)value); }
+        static Value boolean(bool value) { return immediate(ValueType::Bool, value); }
+        static Value null() { return Value(); }
+        // the result of an evaluation which failed, with its error in pending_error();
+        // it never leaves the Evaluator or the VM
+        static Value failure() { return Value(FAILURE); }
+        static Value string(std::string_view text);
+
+        ValueType type() const { return (ValueType)(this->bits & TAG_MASK); }
+        bool is_object() const { return this->type() == ValueType::Object; }
+        bool is_int() const { return this->type() == ValueType::Int; }
+        bool is_failure() const { return this->bits == FAILURE; }
+        bool is_closure() const { return this->is_object() && this->as_object()->kind == ObjectKind::Closure; }
+        bool is_native() const { return this->is_object() && this->as_object()->kind == ObjectKind::Native; }
+        bool is_vector() const { return this->is_object() && this->as_object()->kind == ObjectKind::Vector; }
+        bool is(ObjectKind kind) const { return this->is_object() && this->as_object()->kind == kind; }
+
+        int as_int() const { return (int)this->payload(); }
+        char as_char() const { return (char)this->payload(); }
+        bool as_bool() const { return this->payload() != 0; }
+        Object* as_object() const { return (Object*)this->bits; }
+        const std::string& as_string() const { return ((StringObject*)this->as_object())->text; }
+        ClosureObject* as_closure() const { return (ClosureObject*)this->as_object(); }
+        NativeObject* as_native() const { return (NativeObject*)this->as_object(); }
+        VectorObject* as_vector() const { return (VectorObject*)this->as_object(); }
+
+        // back to the parser's representation, e.g. for printing results.
+        // closures, natives, vectors and collections have no literal form and become null.
+        Literal literal() const;
+    };
+
+    // a failure whose error is pending
+    inline Value fail(ErrorCode code, const char* message) {
+        set_pending_error(code, message);
+        return Value::failure();
+    }
+
+    // writes any value the way it appears inside a collection: strings and chars quoted.
+    void print_value(std::ostream& out, const Value& value);
+
+    // a fn* value: the code of the function and copies of the locals it captured
+    // at the fn* site, in the order of FunctionNode::captures.
+    class ClosureObject : public Object {
+    public:
+        FunctionNode* function;
+        std::vector<Value> captured;
+        ClosureObject(FunctionNode* function);
+        void trace(Heap& heap) const override;
+        size_t footprint() const override;
+    };
+
+    typedef Value (*NativeFunction)(const Value* argv, size_t argc);
+
+    // a function written in C++, called like a closure. `arity < 0` takes any number
+    // of arguments; otherwise the caller checks the count before calling `function`.
+    class NativeObject : public Object {
+    public:
+        const char* name;
+        int arity;
+        NativeFunction function;
+        // label of the native in the Profiler; 0 until it is profiled
+        std::uint32_t profile_label = 0;
+        NativeObject(const char* name, int arity, NativeFunction function);
+        size_t footprint() const override;
+    };
+
+} // namespace lisp
+
+#endif
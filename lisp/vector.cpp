@@ -0,0 +1,195 @@
+#include "vector.hpp"
+
+#include "heap.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <ostream>
+#include <new>
+
+namespace lisp {
+
+    /* VectorObject */
+    VectorObject::VectorObject(size_t length) : Object(ObjectKind::Vector), length(length), capacity(length) {
+        this->data = (int*)::operator new(std::max<size_t>(length, 1) * sizeof(int), std::align_val_t(ALIGNMENT));
+    }
+
+    VectorObject::~VectorObject() {
+        ::operator delete(this->data, std::align_val_t(ALIGNMENT));
+    }
+
+    size_t VectorObject::footprint() const {
+        return sizeof(VectorObject) + this->capacity * sizeof(int);
+    }
+
+    const char* VectorObject::type_name() const {
+        return "vec";
+    }
+
+    void VectorObject::print(std::ostream& out) const {
+        out << "[";
+        for (size_t i = 0; i < this->length; i++)
+            out << (i == 0 ? "" : " ") << this->data[i];
+        out << "]";
+    }
+
+    static VectorObject* __vector_checking(const Value& value) {
+        if (!value.is_vector())
+            throw SyntaxError(ErrorCode::Vector, "[vector error] Data type of operand is not Vector.");
+        return value.as_vector();
+    }
+
+    static int __int_checking(const Value& value) {
+        if (!value.is_int())
+            throw SyntaxError(ErrorCode::Operator, "[operator error] Data type of operand is not Int.");
+        return value.as_int();
+    }
+
+    // no SIMD instruction divides Ints, so every kernel table shares this loop
+    static bool __divide__(const int* a, const int* b, int* out, size_t n) {
+        bool fits = true;
+        for (size_t i = 0; i < n; i++) {
+            if (b[i] == 0)
+                throw SyntaxError(ErrorCode::Operator, "[operator error] Division by zero.");
+            fits &= !(a[i] == INT_MIN && b[i] == -1);
+            out[i] = fits ? a[i] / b[i] : 0;
+        }
+        return fits;
+    }
+
+    // one operand may be an Int, which is used for every element
+    static Value __elementwise__(SymbolId oper, const Value* argv) {
+        bool left = argv[0].is_vector(), right = argv[1].is_vector();
+        if (!left && !right)
+            throw SyntaxError(ErrorCode::Vector, "[vector error] Data type of operand is not Vector.");
+        int scalar = 0;
+        if (!left) scalar = __int_checking(argv[0]);
+        if (!right) scalar = __int_checking(argv[1]);
+        size_t length = left ? argv[0].as_vector()->length : argv[1].as_vector()->length;
+        if (left && right && argv[1].as_vector()->length != length)
+            throw SyntaxError(ErrorCode::Vector, "[vector error] Lengths of vectors are different.");
+
+        VectorObject* result = heap().make<VectorObject>(length);
+        int* out = result->data;
+        if (!left || !right) std::fill(out, out + length, scalar);
+        const int* a = left ? argv[0].as_vector()->data : out;
+        const int* b = right ? argv[1].as_vector()->data : out;
+
+        const VectorKernels& kernels = vector_kernels();
+        bool fits;
+        switch (oper) {
+        case SYM_ADD: fits = kernels.add(a, b, out, length); break;
+        case SYM_SUB: fits = kernels.sub(a, b, out, length); break;
+        case SYM_MUL: fits = kernels.mul(a, b, out, length); break;
+        default: fits = __divide__(a, b, out, length); break;
+        }
+        if (!fits)
+            throw SyntaxError(ErrorCode::Operator, "[operator error] Integer overflow.");
+        return Value(result);
+    }
+
+    static Value __filter__(const Value* argv, int order) {
+        VectorObject* source = __vector_checking(argv[0]);
+        int pivot = __int_checking(argv[1]);
+        VectorObject* result = heap().make<VectorObject>(source->length);
+        result->length = vector_kernels().filter(source->data, source->length, order, pivot, result->data);
+        return Value(result);
+    }
+
+    Value __vec__(const Value* argv, size_t argc) {
+        for (size_t i = 0; i < argc; i++) __int_checking(argv[i]);
+        VectorObject* result = heap().make<VectorObject>(argc);
+        for (size_t i = 0; i < argc; i++) result->data[i] = argv[i].as_int();
+        return Value(result);
+    }
+
+    Value __vec_range__(const Value* argv, size_t /*argc*/) {
+        int length = __int_checking(argv[0]);
+        if (length < 0)
+            throw SyntaxError(ErrorCode::Vector, "[vector error] Length of vector is negative.");
+        VectorObject* result = heap().make<VectorObject>(length);
+        for (int i = 0; i < length; i++) result->data[i] = i;
+        return Value(result);
+    }
+
+    Value __vec_len__(const Value* argv, size_t /*argc*/) {
+        return Value::integer((int)__vector_checking(argv[0])->length);
+    }
+
+    Value __vec_get__(const Value* argv, size_t /*argc*/) {
+        VectorObject* vector = __vector_checking(argv[0]);
+        int index = __int_checking(argv[1]);
+        if (index < 0 || (size_t)index >= vector->length)
+            throw SyntaxError(ErrorCode::Vector, "[vector error] Index is out of range.");
+        return Value::integer(vector->data[index]);
+    }
+
+    Value __vec_add__(const Value* argv, size_t /*argc*/) { return __elementwise__(SYM_ADD, argv); }
+    Value __vec_sub__(const Value* argv, size_t /*argc*/) { return __elementwise__(SYM_SUB, argv); }
+    Value __vec_mul__(const Value* argv, size_t /*argc*/) { return __elementwise__(SYM_MUL, argv); }
+    Value __vec_div__(const Value* argv, size_t /*argc*/) { return __elementwise__(SYM_DIV, argv); }
+
+    Value __vec_sum__(const Value* argv, size_t /*argc*/) {
+        VectorObject* vector = __vector_checking(argv[0]);
+        long long result = vector_kernels().sum(vector->data, vector->length);
+        if (result < INT_MIN || result > INT_MAX)
+            throw SyntaxError(ErrorCode::Operator, "[operator error] Integer overflow.");
+        return Value::integer((int)result);
+    }
+
+    Value __vec_min__(const Value* argv, size_t /*argc*/) {
+        VectorObject* vector = __vector_checking(argv[0]);
+        if (vector->length == 0)
+            throw SyntaxError(ErrorCode::Vector, "[vector error] Vector is empty.");
+        return Value::integer(vector_kernels().min(vector->data, vector->length));
+    }
+
+    Value __vec_max__(const Value* argv, size_t /*argc*/) {
+        VectorObject* vector = __vector_checking(argv[0]);
+        if (vector->length == 0)
+            throw SyntaxError(ErrorCode::Vector, "[vector error] Vector is empty.");
+        return Value::integer(vector_kernels().max(vector->data, vector->length));
+    }
+
+    Value __vec_dot__(const Value* argv, size_t /*argc*/) {
+        VectorObject* a = __vector_checking(argv[0]);
+        VectorObject* b = __vector_checking(argv[1]);
+        if (a->length != b->length)
+            throw SyntaxError(ErrorCode::Vector, "[vector error] Lengths of vectors are different.");
+        int result;
+        if (!vector_kernels().dot(a->data, b->data, a->length, result))
+            throw SyntaxError(ErrorCode::Operator, "[operator error] Integer overflow.");
+        return Value::integer(result);
+    }
+
+    Value __vec_filter_lt__(const Value* argv, size_t /*argc*/) { return __filter__(argv, -1); }
+    Value __vec_filter_eq__(const Value* argv, size_t /*argc*/) { return __filter__(argv, 0); }
+    Value __vec_filter_gt__(const Value* argv, size_t /*argc*/) { return __filter__(argv, 1); }
+
+    void define_vector_natives(Environment& globals) {
+        static const struct {
+            const char* name;
+            int arity;
+            NativeFunction function;
+        } natives[] = {
+            {"vec", -1, __vec__},
+            {"vec-range", 1, __vec_range__},
+            {"vec-len", 1, __vec_len__},
+            {"vec-get", 2, __vec_get__},
+            {"vec+", 2, __vec_add__},
+            {"vec-", 2, __vec_sub__},
+            {"vec*", 2, __vec_mul__},
+            {"vec/", 2, __vec_div__},
+            {"vec-sum", 1, __vec_sum__},
+            {"vec-min", 1, __vec_min__},
+            {"vec-max", 1, __vec_max__},
+            {"vec-dot", 2, __vec_dot__},
+            {"vec-filter<", 2, __vec_filter_lt__},
+            {"vec-filter=", 2, __vec_filter_eq__},
+            {"vec-filter>", 2, __vec_filter_gt__},
+        };
+        for (const auto& native : natives)
+            globals.add(intern(native.name), Value(heap().make<NativeObject>(native.name, native.arity, native.function)));
+    }
+
+} // namespace lisp
@@ -0,0 +1,35 @@
+#ifndef VECTOR_HPP
+#define VECTOR_HPP
+
+#include "environment.hpp"
+#include "error.hpp"
+#include "simd.hpp"
+#include "symbol.hpp"
+#include "value.hpp"
+
+#include <cstddef>
+
+namespace lisp {
+
+    // contiguous Int array, aligned for the SIMD kernels of simd.hpp.
+    class VectorObject : public Object {
+    public:
+        static const size_t ALIGNMENT = 32;
+        int* data;
+        size_t length;
+        size_t capacity;    // never changes, so that footprint() stays the same
+        VectorObject(size_t length);
+        ~VectorObject() override;
+        VectorObject(const VectorObject&) = delete;
+        VectorObject& operator=(const VectorObject&) = delete;
+        size_t footprint() const override;
+        const char* type_name() const override;
+        void print(std::ostream& out) const override;
+    };
+
+    // defines the vector builtins (vec, vec+, vec-sum, ...) as NativeObjects in `globals`.
+    void define_vector_natives(Environment& globals);
+
+} // namespace lisp
+
+#endif
@@ -0,0 +1,273 @@
+#include "vm.hpp"
+#include "parallel.hpp"
+
+#include <climits>
+#include <memory>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LISP_COMPUTED_GOTO 1
+#endif
+
+namespace lisp {
+
+    /* VM */
+    VM::VM(Evaluator& evaluator) : evaluator(evaluator) {
+        heap().add_roots(this);
+    }
+
+    VM::~VM() {
+        heap().remove_roots(this);
+    }
+
+    void VM::mark_roots(Heap& heap) {
+        for (const Value& value : this->stack) heap.mark(value);
+        for (const Value& value : this->slots) heap.mark(value);
+    }
+
+    const Chunk* VM::chunk_of(FunctionNode* function) {
+        if (function->chunk == nullptr)
+            function->chunk = std::make_shared<Chunk>(Compiler::compile(function));
+        return function->chunk.get();
+    }
+
+    // throws the pending error at the instruction `ip` of `current`; the stack and frames
+    // are dropped by the next execute(). code loaded from an image has no positions, so
+    // the calls to it are tried next, then the form.
+    void VM::raise(const Chunk& chunk, const Chunk* current, const Instruction* ip) const {
+        locate_pending_error(current->positions[ip - current->code.data()]);
+        for (size_t i = this->frames.size(); i-- > 0;) {
+            const CallFrame& frame = this->frames[i];
+            locate_pending_error(frame.chunk->positions[frame.ip - 1 - frame.chunk->code.data()]);
+        }
+        locate_pending_error(chunk.positions.back());
+        throw_pending_error();
+    }
+
+    // a native reports an error by throwing, since it may be called from C++ too
+    static Value __call_native(NativeObject* native, const Value* argv, size_t argc) {
+        try {
+            return native->function(argv, argc);
+        } catch (const SyntaxError& error) {
+            set_pending_error(error.code(), error.message(), error.position());
+            return Value::failure();
+        }
+    }
+
+    Value VM::run(ASTNode* root) {
+        Resolver::resolve(root);
+        return this->execute(Compiler::compile(root));
+    }
+
+    Value VM::execute(const Chunk& chunk) {
+        this->stack.clear();
+        this->frames.clear();
+        this->slots.assign(chunk.slot_count, Value::null());
+        const Chunk* current = &chunk;
+        const Instruction* ip = chunk.code.data();
+        size_t base = 0;
+        Value* slots = this->slots.data();
+        std::vector<Value>& stack = this->stack;
+        Environment& globals = this->evaluator.globals;
+
+#define FAIL(code, message)                                                                         \
+        { set_pending_error(code, message); this->raise(chunk, current, ip); }
+
+#define INT_OPERANDS(a, b)                                                                          \
+        Value& lhs = stack[stack.size() - 2];                                                       \
+        const Value& rhs = stack.back();                                                            \
+        if (!lhs.is_int() || !rhs.is_int())                                                         \
+            FAIL(ErrorCode::Operator, "[operator error] Data type of operand is not Int.")          \
+        int a = lhs.as_int(), b = rhs.as_int();
+
+#define ARITHMETIC(oper)                                                                            \
+        size_t argc = ip->operand;                                                                  \
+        Value result = arithmetic(oper, stack.data() + stack.size() - argc, argc);                  \
+        if (result.is_failure()) this->raise(chunk, current, ip);                                   \
+        stack.resize(stack.size() - argc);                                                          \
+        stack.push_back(result);
+
+// two Int operands whose result fits in Int; anything else goes to arithmetic()
+#define BINARY_FAST_PATH(expression)                                                                \
+        if (ip->operand == 2) {                                                                     \
+            Value& lhs = stack[stack.size() - 2];                                                   \
+            const Value& rhs = stack.back();                                                        \
+            if (lhs.is_int() && rhs.is_int()) {                                                     \
+                long long result = (long long)lhs.as_int() expression rhs.as_int();                 \
+                if (result >= INT_MIN && result <= INT_MAX) {                                       \
+                    lhs = Value::integer((int)result);                                              \
+                    stack.pop_back();                                                               \
+                    NEXT();                                                                         \
+                }                                                                                   \
+            }                                                                                       \
+        }
+
+#ifdef LISP_COMPUTED_GOTO
+        static void* labels[] = {
+            &&op_Const, &&op_LoadLocal, &&op_StoreLocal, &&op_LoadGlobal, &&op_DefGlobal,
+            &&op_Add, &&op_Sub, &&op_Mul, &&op_Div, &&op_Eq, &&op_Less,
+            &&op_Jump, &&op_JumpIfFalse, &&op_Closure, &&op_Call, &&op_TailCall, &&op_Fail, &&op_Return
+        };
+#define DISPATCH() goto *labels[(int)ip->op]
+#define CASE(name) op_##name:
+#define NEXT() ip++; DISPATCH()
+        DISPATCH();
+#else
+#define DISPATCH() continue
+#define CASE(name) case OpCode::name:
+#define NEXT() ip++; continue
+        while (true) switch (ip->op) {
+#endif
+        CASE(Const) {
+            stack.push_back(current->constants[ip->operand]);
+            NEXT();
+        }
+        CASE(LoadLocal) {
+            stack.push_back(slots[ip->operand]);
+            NEXT();
+        }
+        CASE(StoreLocal) {
+            slots[ip->operand] = std::move(stack.back());
+            stack.pop_back();
+            NEXT();
+        }
+        CASE(LoadGlobal) {
+            SymbolNode* symbol = current->symbols[ip->operand];
+            Value* now = globals.get(symbol->symbol_id, symbol->global);
+            if (now == nullptr)
+                FAIL(ErrorCode::UndefinedSymbol, "[undefined symbol error] Included symbol have not been defined.")
+            stack.push_back(*now);
+            NEXT();
+        }
+        CASE(DefGlobal) {
+            if (in_parallel_task())
+                FAIL(ErrorCode::Parallel, "[parallel error] def! is not allowed in a parallel task.")
+            this->evaluator.define(ip->operand, stack.back());
+            NEXT();
+        }
+        CASE(Add) {
+            BINARY_FAST_PATH(+)
+            ARITHMETIC(SYM_ADD)
+            NEXT();
+        }
+        CASE(Sub) {
+            BINARY_FAST_PATH(-)
+            ARITHMETIC(SYM_SUB)
+            NEXT();
+        }
+        CASE(Mul) {
+            BINARY_FAST_PATH(*)
+            ARITHMETIC(SYM_MUL)
+            NEXT();
+        }
+        CASE(Div) {
+            ARITHMETIC(SYM_DIV)
+            NEXT();
+        }
+        CASE(Eq) {
+            INT_OPERANDS(a, b)
+            lhs = Value::boolean(a == b);
+            stack.pop_back();
+            NEXT();
+        }
+        CASE(Less) {
+            INT_OPERANDS(a, b)
+            lhs = Value::boolean(a < b);
+            stack.pop_back();
+            NEXT();
+        }
+        CASE(Jump) {
+            ip = current->code.data() + ip->operand;
+            DISPATCH();
+        }
+        CASE(JumpIfFalse) {
+            ValueType type = stack.back().type();
+            bool falsy = type == ValueType::Null || (type == ValueType::Bool && !stack.back().as_bool());
+            stack.pop_back();
+            if (falsy) {
+                ip = current->code.data() + ip->operand;
+                DISPATCH();
+            }
+            NEXT();
+        }
+        CASE(Closure) {
+            FunctionNode* function = current->functions[ip->operand];
+            ClosureObject* closure = heap().make<ClosureObject>(function);
+            size_t count = function->captures.size();
+            for (size_t i = stack.size() - count; i < stack.size(); i++)
+                closure->captured.push_back(std::move(stack[i]));
+            stack.resize(stack.size() - count);
+            stack.push_back(Value(closure));
+            NEXT();
+        }
+        CASE(Call)
+        CASE(TailCall) {
+            size_t argc = ip->operand;
+            size_t callee_index = stack.size() - argc - 1;
+            if (stack[callee_index].is_native()) {
+                // runs on the arguments in place; code after a TailCall only returns
+                NativeObject* native = stack[callee_index].as_native();
+                if (native->arity >= 0 && (size_t)native->arity != argc)
+                    FAIL(ErrorCode::List, "[list error] Mismatch between the number of parameters and the number of input values.")
+                Value result = __call_native(native, stack.data() + callee_index + 1, argc);
+                if (result.is_failure()) this->raise(chunk, current, ip);
+                stack.resize(callee_index);
+                stack.push_back(result);
+                NEXT();
+            }
+            if (!stack[callee_index].is_closure())
+                FAIL(ErrorCode::List, "[list error] First symbol of a list is not a function.")
+            ClosureObject* closure = stack[callee_index].as_closure();
+            if (closure->function->parameters.size() != argc)
+                FAIL(ErrorCode::List, "[list error] Mismatch between the number of parameters and the number of input values.")
+            const Chunk* target = chunk_of(closure->function);
+
+            if (ip->op == OpCode::Call) {
+                this->frames.push_back({current, ip + 1, base});
+                base += current->slot_count;
+            }
+            // a tail call drops the slots of its caller; the arguments are still on the stack
+            this->slots.resize(base);
+            this->slots.resize(base + target->slot_count);
+            slots = this->slots.data() + base;
+            for (size_t i = 0; i < argc; i++)
+                slots[i] = std::move(stack[callee_index + 1 + i]);
+            for (size_t i = 0; i < closure->captured.size(); i++)
+                slots[argc + i] = closure->captured[i];
+            // keeps the code of the function alive while it runs
+            slots[argc + closure->captured.size()] = stack[callee_index];
+            stack.resize(callee_index);
+
+            current = target;
+            ip = target->code.data();
+            DISPATCH();
+        }
+        CASE(Fail) {
+            const Error& error = current->errors[ip->operand];
+            set_pending_error(error.code, error.message, error.position);
+            this->raise(chunk, current, ip);
+        }
+        CASE(Return) {
+            if (this->frames.empty()) return stack.back();
+            this->slots.resize(base);
+            CallFrame frame = this->frames.back();
+            this->frames.pop_back();
+            current = frame.chunk;
+            ip = frame.ip;
+            base = frame.base;
+            slots = this->slots.data() + base;
+            DISPATCH();
+        }
+#ifndef LISP_COMPUTED_GOTO
+        }
+#endif
+
+#undef FAIL
+#undef INT_OPERANDS
+#undef ARITHMETIC
+#undef BINARY_FAST_PATH
+#undef CASE
+#undef NEXT
+#undef DISPATCH
+    }
+
+} // namespace lisp
@@ -0,0 +1,40 @@
+#ifndef VM_HPP
+#define VM_HPP
+
+#include "bytecode.hpp"
+#include "evaluator.hpp"
+
+#include <vector>
+
+namespace lisp {
+
+    // bytecode engine; shares the global environment (globals) with `evaluator`.
+    // calls never recurse on the C++ stack; a TailCall reuses the frame of its caller.
+    class VM : public GcRoots {
+    private:
+        struct CallFrame {
+            const Chunk* chunk;
+            const Instruction* ip;  // where to continue after the callee returns
+            size_t base;            // first slot of the frame
+        };
+
+        Evaluator& evaluator;
+        std::vector<Value> stack;
+        std::vector<Value> slots;
+        std::vector<CallFrame> frames;
+
+        static const Chunk* chunk_of(FunctionNode* function);
+        [[noreturn]] void raise(const Chunk& chunk, const Chunk* current, const Instruction* ip) const;
+    public:
+        VM(Evaluator& evaluator);
+        ~VM();
+        VM(const VM&) = delete;
+        VM& operator=(const VM&) = delete;
+        void mark_roots(Heap& heap) override;
+        Value run(ASTNode* root);
+        Value execute(const Chunk& chunk);
+    };
+
+} // namespace lisp
+
+#endif
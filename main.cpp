@@ -1,42 +1,98 @@
 #include "lisp/lisp.hpp"
 
+#include <csignal>
 #include <iostream>
-#include <fstream>
+#include <string>
+#include <vector>
 
 int main(int argc, char* argv[]) {
-    if (argc <= 1) {
-        std::cerr << "There is not given file path.\n";
-        return -1;
+    std::vector<std::string> files;
+    lisp::BatchOptions options;
+    bool batch = false;
+    bool jit_stats = false;
+    bool cache_stats = false;
+    lisp::ServerOptions server;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--mmap") options.run.use_mmap = true;
+        else if (arg == "--vm") options.run.use_vm = true;
+        else if (arg == "--gc-stats") options.gc_stats = true;
+        else if (arg == "--no-fold") options.run.fold = false;
+        else if (arg == "--no-simd") lisp::use_simd(false);
+        else if (arg == "--jit") options.run.jit = true;
+        else if (arg == "--jit-stats") jit_stats = true;
+        else if (arg.rfind("--jit-threshold=", 0) == 0) lisp::Jit::set_threshold(std::stoul(arg.substr(16)));
+        else if (arg == "--ast") options.run.print_ast = true;
+        else if (arg.rfind("--cache=", 0) == 0) options.run.cache = std::stoul(arg.substr(8));
+        else if (arg == "--cache-stats") cache_stats = true;
+        else if (arg == "--batch") batch = true;
+        else if (arg.rfind("--image=", 0) == 0) options.run.image = arg.substr(8);
+        else if (arg.rfind("--save-image=", 0) == 0) options.run.save_image = arg.substr(13);
+        else if (arg.rfind("--profile=", 0) == 0) options.run.profile = arg.substr(10);
+        else if (arg.rfind("--jobs=", 0) == 0) options.jobs = std::stoul(arg.substr(7));
+        else if (arg.rfind("--manifest=", 0) == 0) {
+            batch = true;
+            if (!lisp::read_manifest(arg.substr(11), files)) {
+                std::cerr << arg.substr(11) << "is inaccessible.\n";
+                return -1;
+            }
+        }
+        else if (arg.rfind("--threads=", 0) == 0) lisp::set_parallelism(std::stoul(arg.substr(10)));
+        else if (arg.rfind("--gc-threshold=", 0) == 0) options.gc_threshold = std::stoul(arg.substr(15));
+        else if (arg.rfind("--serve=", 0) == 0) server.path = arg.substr(8);
+        else if (arg.rfind("--workers=", 0) == 0) server.workers = std::stoul(arg.substr(10));
+        else if (arg.rfind("--prelude=", 0) == 0) server.prelude = arg.substr(10);
+        else files.push_back(arg);
     }
 
-    std::string filename = argv[1];
+    if (options.run.jit && options.run.use_vm) {
+        std::cerr << "--jit is not allowed with --vm.\n";
+        return -1;
+    }
+    if (batch && !options.run.save_image.empty()) {
+        std::cerr << "--save-image is not allowed with --batch.\n";
+        return -1;
+    }
+    if (batch && !options.run.profile.empty()) {
+        std::cerr << "--profile is not allowed with --batch.\n";
+        return -1;
+    }
+    if (!server.path.empty()) {
+        if (batch || !options.run.save_image.empty() || !options.run.profile.empty() || options.run.print_ast) {
+            std::cerr << "--batch, --save-image, --profile and --ast are not allowed with --serve.\n";
+            return -1;
+        }
+        server.run = options.run;
+        server.gc_threshold = options.gc_threshold;
+        std::signal(SIGINT, [](int) { lisp::stop_server(); });
+        std::signal(SIGTERM, [](int) { lisp::stop_server(); });
+        lisp::serve(server, std::cerr);
+        if (jit_stats) lisp::Jit::print_stats(std::cerr);
+        if (cache_stats) lisp::FormCache::print_stats(std::cerr);
+        return 0;
+    }
+    if (batch) {
+        size_t failed = lisp::run_batch(files, options, std::cout, std::cerr);
+        if (jit_stats) lisp::Jit::print_stats(std::cerr);
+        if (cache_stats) lisp::FormCache::print_stats(std::cerr);
+        return failed == 0 ? 0 : 1;
+    }
 
-    std::ifstream file(filename);
+    if (files.empty()) {
+        std::cerr << "There is not given file path.\n";
+        return -1;
+    }
 
-    if (!file.is_open()) {
+    std::string filename = files.back();
+    if (options.gc_threshold > 0) lisp::heap().configure(options.gc_threshold, 2.0);
+    if (!lisp::run_file(filename, options.run, std::cout)) {
         std::cerr << filename << "is inaccessible.\n";
         return -1;
     }
 
-    std::string code;
-    lisp::Evaluator evaluator = lisp::Evaluator();
-    while (std::getline(file, code)) {
-        if (code.length() == 0) continue;
-
-        lisp::Parser parser = lisp::read_str(code);
-
-        parser.print();
-
-        lisp::Literal result = evaluator.run(((lisp::ListNode*)parser.root)->sub_nodes[0]);
-
-        std::visit([](const auto& val) {
-            if constexpr (std::is_same_v<std::decay_t<decltype(val)>, std::nullptr_t>) {
-                std::cout << "nullptr\n";
-            } else {
-                std::cout << val << " (" << typeid(val).name() << ")\n";
-            }
-        }, result);
-    }
+    if (options.gc_stats) lisp::heap().print_stats(std::cerr);
+    if (jit_stats) lisp::Jit::print_stats(std::cerr);
+    if (cache_stats) lisp::FormCache::print_stats(std::cerr);
 
     return 0;
-}
\ No newline at end of file
+}